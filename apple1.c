@@ -25,6 +25,11 @@
 #include "apple1.h"
 #include "pia6821.h"
 #include "m6502_opcodes.h"
+#include "m6502_instr.h"
+#include "m6502_jit.h"
+#include "m6502_profile.h"
+#include "savestate.h"
+#include "rewind.h"
 #include "debug.h"
 
 #include <stdio.h>
@@ -32,240 +37,511 @@
 #include <pthread.h>
 #include <signal.h>
 #include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+Apple1Machine* create_apple1() {
+  Apple1Machine* m = calloc(1, sizeof(Apple1Machine));
+  if(m == NULL) {
+    fprintf(stderr, "Unable to alloc machine\n");
+    return NULL;
+  }
+  m->read_only = true;
+  m->savestate_path = DEFAULT_SAVESTATE_PATH;
+  m->paste_fd = -1;
+
+  m->cpu_callback.callback = &clock_cpu;
+  m->cpu_callback.chip = &m->cpu;
+  m->bus_callback.callback = &clock_bus;
+  m->bus_callback.chip = &m->bus;
+  // The CPU runs the whole machine, so the clock can hand it batches of
+  // cycles. With the Apple I ROM, we also look for the CPU waiting on the
+  // keyboard
+  m->apple1_runner.callback = &run_apple1;
+  m->apple1_runner.chip = m;
+  // Memory writes drop the instructions decoded at that address
+  m->cpu_write_listener.callback = &invalidate_decoded;
+  m->cpu_write_listener.listener = &m->cpu;
+
+  m->user_ram_callback.callback = &clock_mem;
+  m->user_ram_callback.chip = &m->user_ram;
+  m->extra_ram_callback.callback = &clock_mem;
+  m->extra_ram_callback.chip = &m->extra_ram;
+  m->rom_callback.callback = &clock_mem;
+  m->rom_callback.chip = &m->rom;
+  m->pia_callback.callback = &clock_pia;
+  m->pia_callback.chip = &m->pia;
+  // Scheduling something sooner than the CPU was going to run until gets it
+  // to return early
+  init_scheduler(&m->scheduler, &m->cpu.tick_count, &m->cpu.exit_requested);
+  m->pia.scheduler = &m->scheduler;
+  init_display(&m->display, STDOUT_FILENO);
+  init_keyboard(&m->pia.keyboard);
+  init_keyboard(&m->pia.paste);
+  m->pia.display = &m->display;
+  m->pia.display_cycles = DISPLAY_LATENCY;
+
+  // To park the clock thread while the CPU is just waiting for a key
+  pthread_mutex_init(&m->idle_lock, NULL);
+  pthread_cond_init(&m->idle_wake, NULL);
+  pthread_mutex_init(&m->paste_lock, NULL);
+  pthread_cond_init(&m->paste_done, NULL);
+  return m;
+}
 
-float emulation_speed = 0.0;
-
-volatile uint16_t address_bus;
-volatile uint8_t data_bus;
-volatile bool reset_line;
-volatile bool poweroff = false;
-volatile bool debug_mode = false;
-
-M6502 cpu;
-Connected_chip cpu_callback = {
-  .callback = &clock_cpu,
-  .chip = &cpu,
-};
-
-Clock main_clock;
-
-Mem_16 user_ram;
-Connected_chip user_ram_callback = {
-  .callback = &clock_mem,
-  .chip = &user_ram,
-};
-Mem_16 extra_ram;
-Connected_chip extra_ram_callback = {
-  .callback = &clock_mem,
-  .chip = &extra_ram,
-};
-Mem_16 rom;
-Connected_chip rom_callback = {
-  .callback = &clock_mem,
-  .chip = &rom,
-};
-
-PIA6821 pia;
-Connected_chip pia_callback = {
-  .callback = &clock_pia,
-  .chip = &pia,
-};
-
-bool read_only = true;
-bool on = true;
-bool off = false;
-
-int init_apple1(size_t user_ram_size, uint8_t* rom_data, size_t rom_length, uint8_t* extra_data, size_t extra_length) {
+void destroy_apple1(Apple1Machine* m) {
+  if(m == NULL) {
+    return;
+  }
+  destroy_mem(&m->user_ram);
+  destroy_mem(&m->extra_ram);
+  destroy_mem(&m->rom);
+  destroy_cpu(&m->cpu);
+  destroy_rewind(m);
+  destroy_display(&m->display);
+  destroy_keyboard(&m->pia.keyboard);
+  destroy_keyboard(&m->pia.paste);
+  if(m->paste_fd != -1 && m->paste_fd != STDIN_FILENO) {
+    close(m->paste_fd);
+  }
+  pthread_mutex_destroy(&m->idle_lock);
+  pthread_cond_destroy(&m->idle_wake);
+  pthread_mutex_destroy(&m->paste_lock);
+  pthread_cond_destroy(&m->paste_done);
+  free(m);
+}
+
+int init_apple1(Apple1Machine* m, size_t user_ram_size, uint8_t* rom_data, size_t rom_length, uint8_t* extra_data, size_t extra_length) {
   int ret;
 
   // Connect PIA
-  pia.addr_bus = &address_bus;
-  pia.data_bus = &data_bus;
-  pia.RW = &cpu.RW;
-  pia.CRA_ADDR = KBDCR;
-  pia.CRB_ADDR = DSPCR;
-  pia.PA_ADDR = KBD;
-  pia.PB_ADDR = DSP;
-  pia.RES = &reset_line;
+  m->pia.addr_bus = &m->address_bus;
+  m->pia.data_bus = &m->data_bus;
+  m->pia.RW = &m->cpu.RW;
 
   // Connect RAMs and ROM
   if(user_ram_size > MAX_USER_RAM) {
     fprintf(stderr, "Requested too much user memory. Maximum is 0x%02X\n", MAX_USER_RAM);
     return ERROR_TOO_MUCH_USER_MEMORY;
   }
-  ret = init_mem(&user_ram, START_USER_RAM, user_ram_size - 1);
+  ret = init_mem(&m->user_ram, START_USER_RAM, user_ram_size - 1);
   if(ret != SUCCESS) {
     return FAILURE;
   }
-  user_ram.addr_bus = &address_bus;
-  user_ram.data_bus = &data_bus;
-  user_ram.RW = &cpu.RW;
+  m->user_ram.addr_bus = &m->address_bus;
+  m->user_ram.data_bus = &m->data_bus;
+  m->user_ram.RW = &m->cpu.RW;
+  m->user_ram.write_listener = &m->cpu_write_listener;
+  allow_decode_cache(&m->cpu, m->user_ram.start_addr, m->user_ram.end_addr);
 
-  ret = init_mem(&extra_ram, START_EXTRA_RAM, END_EXTRA_RAM);
+  ret = init_mem(&m->extra_ram, START_EXTRA_RAM, END_EXTRA_RAM);
   if(ret != SUCCESS) {
     return FAILURE;
   }
-  extra_ram.addr_bus = &address_bus;
-  extra_ram.data_bus = &data_bus;
-  extra_ram.RW = &(cpu.RW);
+  m->extra_ram.addr_bus = &m->address_bus;
+  m->extra_ram.data_bus = &m->data_bus;
+  m->extra_ram.RW = &(m->cpu.RW);
+  m->extra_ram.write_listener = &m->cpu_write_listener;
+  allow_decode_cache(&m->cpu, m->extra_ram.start_addr, m->extra_ram.end_addr);
   if(extra_data != NULL) {
-    load_data(&extra_ram, extra_data, extra_length, START_EXTRA_RAM);
+    load_data(&m->extra_ram, extra_data, extra_length, START_EXTRA_RAM);
     if(ret != SUCCESS) {
       return FAILURE;
     }
   }
 
-  ret = init_mem(&rom, START_ROM, END_ROM);
+  ret = init_mem(&m->rom, START_ROM, END_ROM);
   if(ret != SUCCESS) {
     return FAILURE;
   }
-  rom.addr_bus = &address_bus;
-  rom.data_bus = &data_bus;
-  rom.RW = &read_only;
-  load_data(&rom, rom_data, rom_length, START_ROM);
+  m->rom.addr_bus = &m->address_bus;
+  m->rom.data_bus = &m->data_bus;
+  m->rom.RW = &m->read_only;
+  allow_decode_cache(&m->cpu, m->rom.start_addr, m->rom.end_addr);
+  load_data(&m->rom, rom_data, rom_length, START_ROM);
   if(ret != SUCCESS) {
     return FAILURE;
   }
 
   // Connect CPU
-  cpu.addr_bus = &address_bus;
-  cpu.data_bus = &data_bus;
-  cpu.IRQ = &on;
-  cpu.NMI = &on;
-  cpu.RDY = &on;
-  cpu.SO = &on;
-  cpu.RES = &reset_line;
+  m->cpu.addr_bus = &m->address_bus;
+  m->cpu.data_bus = &m->data_bus;
   // If the CPU stops, shut the rest of the stuff down
-  cpu.stop = &poweroff;
-  ret = clock_connect(&cpu.phi2, &user_ram_callback);
+  m->cpu.stop = &m->poweroff;
+  // Every access only goes to what's mapped at that address, instead of all
+  // of the chips checking if it's for them
+  init_bus(&m->bus, &m->address_bus, &m->data_bus, &m->cpu.RW);
+  ret = bus_map_mem(&m->bus, &m->user_ram, true, &m->user_ram_callback);
   if(ret != SUCCESS) {
     return FAILURE;
   }
-  ret = clock_connect(&cpu.phi2, &extra_ram_callback);
+  ret = bus_map_mem(&m->bus, &m->extra_ram, true, &m->extra_ram_callback);
   if(ret != SUCCESS) {
     return FAILURE;
   }
-  ret = clock_connect(&cpu.phi2, &rom_callback);
+  ret = bus_map_mem(&m->bus, &m->rom, false, &m->rom_callback);
   if(ret != SUCCESS) {
     return FAILURE;
   }
-  ret = clock_connect(&cpu.phi2, &pia_callback);
+  ret = bus_map_device(&m->bus, KBD, DSPCR, &m->pia_callback);
+  if(ret != SUCCESS) {
+    return FAILURE;
+  }
+  ret = clock_connect(&m->cpu.phi2, &m->bus_callback);
   if(ret != SUCCESS) {
     return FAILURE;
   }
 
-  init_clock(&main_clock, CLOCK_SPEED);
-  ret = clock_connect(&main_clock, &cpu_callback);
+  init_clock(&m->main_clock, CLOCK_SPEED);
+  ret = clock_connect(&m->main_clock, &m->cpu_callback);
   if(ret != SUCCESS) {
     return FAILURE;
   }
-  main_clock.stop = &poweroff;
+  m->main_clock.stop = &m->poweroff;
+  m->main_clock.cycle_count = &m->cpu.tick_count;
+  m->main_clock.runner = &m->apple1_runner;
 
   return SUCCESS;
 }
 
-int init_apple1_binary(uint8_t* binary_data, size_t binary_length, uint16_t start_addr, uint16_t load_addr) {
+int init_apple1_binary(Apple1Machine* m, uint8_t* binary_data, size_t binary_length, uint16_t start_addr, uint16_t load_addr) {
   int ret;
 
   // Connect RAM
-  ret = init_mem(&user_ram, START_USER_RAM, MEMSIZE-1);
+  ret = init_mem(&m->user_ram, START_USER_RAM, MEMSIZE-1);
   if(ret != SUCCESS) {
     return FAILURE;
   }
-  user_ram.addr_bus = &address_bus;
-  user_ram.data_bus = &data_bus;
-  user_ram.RW = &cpu.RW;
+  m->user_ram.addr_bus = &m->address_bus;
+  m->user_ram.data_bus = &m->data_bus;
+  m->user_ram.RW = &m->cpu.RW;
+  m->user_ram.write_listener = &m->cpu_write_listener;
+  allow_decode_cache(&m->cpu, m->user_ram.start_addr, m->user_ram.end_addr);
 
-  load_data(&user_ram, binary_data, binary_length, load_addr);
+  load_data(&m->user_ram, binary_data, binary_length, load_addr);
   if(ret != SUCCESS) {
     return FAILURE;
   }
 
-  user_ram.mem[0xFFFC] = start_addr & 0x00FF;
-  user_ram.mem[0xFFFD] = (start_addr & 0xFF00) >> 8;
+  m->user_ram.mem[0xFFFC] = start_addr & 0x00FF;
+  m->user_ram.mem[0xFFFD] = (start_addr & 0xFF00) >> 8;
 
   // Connect CPU
-  cpu.addr_bus = &address_bus;
-  cpu.data_bus = &data_bus;
-  cpu.IRQ = &on;
-  cpu.NMI = &on;
-  cpu.RDY = &on;
-  cpu.SO = &on;
-  cpu.RES = &reset_line;
+  m->cpu.addr_bus = &m->address_bus;
+  m->cpu.data_bus = &m->data_bus;
   // If the CPU stops, shut the rest of the stuff down
-  cpu.stop = &poweroff;
-  ret = clock_connect(&cpu.phi2, &user_ram_callback);
+  m->cpu.stop = &m->poweroff;
+  init_bus(&m->bus, &m->address_bus, &m->data_bus, &m->cpu.RW);
+  ret = bus_map_mem(&m->bus, &m->user_ram, true, &m->user_ram_callback);
+  if(ret != SUCCESS) {
+    return FAILURE;
+  }
+  ret = clock_connect(&m->cpu.phi2, &m->bus_callback);
   if(ret != SUCCESS) {
     return FAILURE;
   }
 
-  init_clock(&main_clock, CLOCK_SPEED);
-  ret = clock_connect(&main_clock, &cpu_callback);
+  init_clock(&m->main_clock, CLOCK_SPEED);
+  ret = clock_connect(&m->main_clock, &m->cpu_callback);
   if(ret != SUCCESS) {
     return FAILURE;
   }
-  main_clock.stop = &poweroff;
+  m->main_clock.stop = &m->poweroff;
+  m->main_clock.cycle_count = &m->cpu.tick_count;
+  m->main_clock.runner = &m->apple1_runner;
 
   return SUCCESS;
 }
 
-void process_emulator_input(char key) {
+// Reads memory without going through the CPU, leaving the bus as it was
+uint8_t peek(Apple1Machine* m, uint16_t addr) {
+  uint16_t prev_addr = m->address_bus;
+  uint8_t prev_data = m->data_bus;
+  bool prev_RW = m->cpu.RW;
+  m->address_bus = addr;
+  m->cpu.RW = true;
+  tick(&m->cpu.phi2);
+  uint8_t value = m->data_bus;
+  m->address_bus = prev_addr;
+  m->data_bus = prev_data;
+  m->cpu.RW = prev_RW;
+  return value;
+}
+
+// Cycles taken by every iteration of the loop the CPU is in, if it's just
+// polling the keyboard with no key coming: LDA or BIT on KBDCR followed by a
+// BPL back to it, like the Woz Monitor and BASIC do. 0 otherwise
+unsigned int keyboard_poll_period(Apple1Machine* m) {
+  // Fast-forwarding would leave pending events behind
+  if(!m->cpu.SYNC || pia_key_waiting(&m->pia) || (m->pia.CRA & 0x80) || next_event(&m->scheduler) != NO_EVENT) {
+    return 0;
+  }
+  uint16_t loop = m->cpu.PC;
+  if(m->cpu.PC + KEYBOARD_POLL_LENGTH > KBD && m->cpu.PC - 3 <= DSPCR) {
+    // Don't even peek if that would read the PIA
+    return 0;
+  }
+  uint8_t opcode = peek(m, loop);
+  if(opcode != 0xAD && opcode != 0x2C) {
+    // Could be about to run the BPL, as long as it's going to be taken
+    loop -= 3;
+    if(m->cpu.status & STATUS_NF) {
+      return 0;
+    }
+    opcode = peek(m, loop);
+  }
+  if((opcode != 0xAD && opcode != 0x2C) ||
+     peek(m, loop + 1) != (KBDCR & 0x00FF) || peek(m, loop + 2) != (KBDCR >> 8) ||
+     peek(m, loop + 3) != 0x10 || peek(m, loop + 4) != (uint8_t)-KEYBOARD_POLL_LENGTH) {
+    return 0;
+  }
+  // LDA/BIT absolute, and the branch back, which takes an extra cycle if it
+  // crosses a page
+  return 4 + 3 + ((((loop + KEYBOARD_POLL_LENGTH) ^ loop) & 0xFF00) ? 1 : 0);
+}
+
+// Waits until there's a key to read, some line gets asserted or someone else
+// needs the clock. Every time it wakes up, the CPU gets fast-forwarded by the
+// whole iterations of the poll loop it would have run in the meantime, so
+// emulated time keeps going
+unsigned long long park_until_input(Apple1Machine* m, unsigned int period) {
+  struct timespec begin;
+  struct timespec now;
+  struct timespec deadline;
+  unsigned long long skipped = 0;
+  clock_gettime(CLOCK_MONOTONIC, &begin);
+  pthread_mutex_lock(&m->idle_lock);
+  while(!pia_key_waiting(&m->pia) && !m->cpu.lines && !m->poweroff && m->main_clock.enabled && m->cpu.enabled) {
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += IDLE_PARK_TIMEOUT;
+    if(deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+    pthread_cond_timedwait(&m->idle_wake, &m->idle_lock, &deadline);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double elapsed = (now.tv_sec - begin.tv_sec) + (now.tv_nsec - begin.tv_nsec) / 1e9;
+    unsigned long long due = (unsigned long long)(elapsed * m->main_clock.freq) / period * period;
+    // Two instructions per iteration, the load and the branch
+    m->cpu.tick_count += due - skipped;
+    m->cpu.instructions += 2 * (due - skipped) / period;
+    skipped = due;
+  }
+  pthread_mutex_unlock(&m->idle_lock);
+  return skipped;
+}
+
+unsigned long long run_apple1_cycles(Apple1Machine* m, unsigned long long cycles) {
+  M6502* cpu = &m->cpu;
+  Scheduler* s = &m->scheduler;
+  unsigned long long ran = 0;
+  while(ran < cycles) {
+    unsigned long long slice = cycles - ran;
+    unsigned long long next = next_event(s);
+    if(next <= cpu->tick_count) {
+      run_events(s);
+      continue;
+    }
+    if(next - cpu->tick_count < slice) {
+      slice = next - cpu->tick_count;
+    }
+    s->horizon = cpu->tick_count + slice;
+    unsigned long long slice_ran = cpu_run_cycles(cpu, slice);
+    s->horizon = 0;
+    ran += slice_ran;
+    run_events(s);
+    // Resuming would run over the breakpoint
+    if(!slice_ran || (cpu->break_enabled && cpu->SYNC && cpu->PC == cpu->break_addr)) {
+      break;
+    }
+  }
+  return ran;
+}
+
+unsigned long long run_apple1(void* ptr, unsigned long long cycles) {
+  Apple1Machine* m = (Apple1Machine*)ptr;
+  // No keyboard in binary mode
+  bool keyboard = m->pia.addr_bus != NULL;
+  if(keyboard) {
+    // Keys come from the input thread, so they're only picked up in between
+    deliver_key(&m->pia);
+  }
+  unsigned long long ran = run_apple1_cycles(m, cycles);
+  kick_display(&m->display);
+  unsigned int period = keyboard ? keyboard_poll_period(m) : 0;
+  if(period) {
+    ran += park_until_input(m, period);
+  }
+  capture_rewind(m);
+  return ran;
+}
+
+void wake_apple1(Apple1Machine* m) {
+  pthread_mutex_lock(&m->idle_lock);
+  pthread_cond_broadcast(&m->idle_wake);
+  pthread_mutex_unlock(&m->idle_lock);
+}
+
+// Stops the clock thread and waits until it's out of the machine. It could be
+// parked waiting for input, so it gets woken up to notice
+static void pause_apple1(Apple1Machine* m) {
+  m->main_clock.enabled = false;
+  wake_apple1(m);
+  while(m->main_clock.active) {
+    // spin
+  }
+}
+
+static void resume_apple1(Apple1Machine* m) {
+  m->main_clock.enabled = true;
+}
+
+void process_emulator_input(Apple1Machine* m, char key) {
+  Clock_jitter jitter;
   switch(key) {
     case EMULATOR_CONTINUE:
-        debug_mode = false;
+        m->debug_mode = false;
     break;
     case EMULATOR_RESET:
-      reset_line = false;
+      cpu_set_line(&m->cpu, LINE_RES, true);
+      wake_apple1(m);
       clear_screen();
     break;
     case EMULATOR_BREAK:
-      debug_mode = true;
-      poweroff = true;
+      m->debug_mode = true;
+      m->poweroff = true;
     break;
     case EMULATOR_STEP_INSTRUCTION:
-      if(debug_mode) {
+      if(m->debug_mode) {
         do{
-          tick(&main_clock);
-          tock(&main_clock);
-        } while(!cpu.SYNC);
-        print_disassembly(&cpu, cpu.PC, 1);
+          tick(&m->main_clock);
+          tock(&m->main_clock);
+          run_events(&m->scheduler);
+        } while(!m->cpu.SYNC);
+        flush_display(&m->display);
+        print_disassembly(&m->cpu, m->cpu.PC, 1);
       }
     break;
     case EMULATOR_STEP_CLOCK:
-      if(debug_mode) {
-        tick(&main_clock);
-        tock(&main_clock);
-        if(cpu.SYNC) {
-          print_disassembly(&cpu, cpu.PC, 1);
+      if(m->debug_mode) {
+        tick(&m->main_clock);
+        tock(&m->main_clock);
+        run_events(&m->scheduler);
+        flush_display(&m->display);
+        if(m->cpu.SYNC) {
+          print_disassembly(&m->cpu, m->cpu.PC, 1);
         }
       }
     break;
     case EMULATOR_PRINT_CYCLES:
-      fprintf(stderr, "cycles per second: %.2f\n", emulation_speed);
+      fprintf(stderr, "cycles per second: %.2f\n", m->emulation_speed);
+      get_clock_jitter(&m->main_clock, &jitter);
+      if(jitter.samples) {
+        print_clock_jitter(&m->main_clock);
+      }
     break;
     case EMULATOR_SAVE_STATE:
-      main_clock.enabled = false;
-      while(main_clock.active) {
-        // spin
-      }
-      save_state(&cpu);
-      main_clock.enabled = true;
+      pause_apple1(m);
+      save_apple1_state(m, m->savestate_slot);
+      resume_apple1(m);
     break;
     case EMULATOR_LOAD_STATE:
-      main_clock.enabled = false;
-      while(main_clock.active) {
-        // spin
+      pause_apple1(m);
+      load_apple1_state(m, m->savestate_slot);
+      resume_apple1(m);
+    break;
+    case EMULATOR_REWIND:
+      pause_apple1(m);
+      if(!rewind_apple1(m, 1)) {
+        fprintf(stderr, "Nothing to rewind\n");
       }
-      load_state(&cpu);
-      main_clock.enabled = true;
+      resume_apple1(m);
     break;
     case EMULATOR_TURBO:
-      main_clock.turbo = !main_clock.turbo;
-      fprintf(stderr, "Turbo mode: %s\n", main_clock.turbo ? "ON" : "OFF");
+      m->main_clock.turbo = !m->main_clock.turbo;
+      fprintf(stderr, "Turbo mode: %s\n", m->main_clock.turbo ? "ON" : "OFF");
+    break;
+    case EMULATOR_INSTRUCTION_MODE:
+      set_instruction_mode(m, m->cpu.requested_mode != CPU_MODE_INSTRUCTION);
+      fprintf(stderr, "Instruction mode: %s\n", m->cpu.requested_mode == CPU_MODE_INSTRUCTION ? "ON" : "OFF");
+    break;
+    case EMULATOR_JIT:
+      set_jit(m, m->cpu.jit == NULL || !m->cpu.jit->enabled);
+      fprintf(stderr, "JIT: %s\n", (m->cpu.jit != NULL && m->cpu.jit->enabled) ? "ON" : "OFF");
     break;
   }
 }
 
+void set_instruction_mode(Apple1Machine* m, bool enabled) {
+  // The CPU will pick this up on the next instruction boundary
+  m->cpu.requested_mode = enabled ? CPU_MODE_INSTRUCTION : CPU_MODE_CYCLE;
+}
+
+void set_jit(Apple1Machine* m, bool enabled) {
+  if(enabled && m->cpu.jit == NULL) {
+    // Set up the first time it's needed, with the clock stopped
+    pause_apple1(m);
+    int ret = init_jit(&m->cpu, KBD, DSPCR);
+    resume_apple1(m);
+    if(ret != SUCCESS) {
+      return;
+    }
+  }
+  if(m->cpu.jit != NULL) {
+    // Turning it off just makes everything go through the interpreter again,
+    // the translations are kept up to date anyway
+    m->cpu.jit->enabled = enabled;
+  }
+  if(enabled) {
+    // Translated code only runs in instruction mode
+    set_instruction_mode(m, true);
+  }
+}
+
+void set_display_rate(Apple1Machine* m, unsigned int rate) {
+  m->pia.display_cycles = rate ? CLOCK_SPEED / rate : DISPLAY_LATENCY;
+}
+
+int set_paste(Apple1Machine* m, const char* path) {
+  int fd = STDIN_FILENO;
+  if(strcmp(path, "-")) {
+    fd = open(path, O_RDONLY);
+    if(fd == -1) {
+      fprintf(stderr, "Error opening file: %s\n", path);
+      return ERROR_OPEN_FILE;
+    }
+  }
+  m->paste_fd = fd;
+  m->paste_pos = 0;
+  m->paste_length = 0;
+  m->paste_last = 0;
+  return SUCCESS;
+}
+
+void set_profile(Apple1Machine* m, bool enabled) {
+  pause_apple1(m);
+  if(enabled) {
+    init_profile(&m->cpu);
+  } else {
+    destroy_profile(&m->cpu);
+  }
+  resume_apple1(m);
+}
+
+void set_call_profile(Apple1Machine* m, const char* path) {
+  pause_apple1(m);
+  if(path != NULL) {
+    init_call_profile(&m->cpu);
+  } else {
+    destroy_call_profile(&m->cpu);
+  }
+  m->folded_stacks_path = path;
+  resume_apple1(m);
+}
+
 void print_greeting() {
   printf("                   _        _                        \n");
   printf("  __ _ _ __  _ __ | | ___  / |   ___ _ __ ___  _   _ \n");
@@ -278,6 +554,8 @@ void print_greeting() {
   printf("F5: Resume execution (From debugger)    F8: Reset\n");
   printf("F6: Save state                          F9: Break to debugger\n");
   printf("F7: Load state                          F12: Print emulation speed\n");
+  printf("F2: Rewind a bit\n");
+  printf("F3: Toggle JIT                          F4: Toggle instruction mode\n");
   printf("\n\n");
 }
 
@@ -291,38 +569,49 @@ void print_debugger_help() {
   printf("br or breakpointr <ADDR>: Break when we try to read this address\n");
   printf("p or print PC/A/X/Y/S/<ADDR>: Print the value of the specified register or memory\n");
   printf("set PC/A/X/Y/S/<ADDR> <VALUE>: Change value of the specified register or memory\n");
+  printf("pf or profile [clear]: Print the hottest opcodes and addresses, or start over\n");
+  printf("calls: Print the subroutines taking the most cycles\n");
+  printf("save [SLOT]: Save the state to this slot, or the current one\n");
+  printf("load [SLOT]: Load the state from this slot, or the current one\n");
+  printf("rewind [STEPS]: Go back in time this many snapshots, or just one\n");
   printf("h or help: This thing\n");
   printf("q or quit: Exit the emulator\n");
 }
 
-int main_loop() {
+int main_loop(Apple1Machine* m) {
   pthread_t clock_thread;
   pthread_t input_thread;
-  if(pthread_create(&input_thread, NULL, input_run, (void*)&poweroff)) {
+  pthread_t paste_thread;
+  bool pasting = __atomic_load_n(&m->paste_fd, __ATOMIC_ACQUIRE) != -1;
+  if(start_display(&m->display) != SUCCESS) {
+    return ERROR_PTHREAD_CREATE;
+  }
+  if(pthread_create(&input_thread, NULL, input_run, m)) {
+    fprintf(stderr, "Error creating thread\n");
+    return ERROR_PTHREAD_CREATE;
+  }
+  if(pasting && pthread_create(&paste_thread, NULL, paste_run, m)) {
     fprintf(stderr, "Error creating thread\n");
     return ERROR_PTHREAD_CREATE;
   }
-  if(pthread_create(&clock_thread, NULL, clock_run, &main_clock)) {
+  if(pthread_create(&clock_thread, NULL, clock_run, &m->main_clock)) {
     fprintf(stderr, "Error creating thread\n");
     return ERROR_PTHREAD_CREATE;
   }
-  while(!poweroff) {
-    // Main control loop
-    unsigned int start_ticks = cpu.tick_count;
+  while(!m->poweroff) {
+    // Main control loop, the clock thread does the pacing
+    unsigned long long start_ticks = m->cpu.tick_count;
     sleep(1);
-    emulation_speed = (float)((cpu.tick_count - start_ticks));
-    if(!main_clock.turbo) {
-      if(emulation_speed > CLOCK_SPEED) {
-        main_clock.clock_adjust -= CLOCK_ADJUST_GRANULARITY;
-      } else if(emulation_speed < CLOCK_SPEED) {
-        main_clock.clock_adjust += CLOCK_ADJUST_GRANULARITY;
-      }
-    }
+    m->emulation_speed = (float)((m->cpu.tick_count - start_ticks));
   }
   // Send SIGINT to the input thread so that the read syscall gets interrupted
   if(pthread_kill(input_thread, SIGINT)) {
     fprintf(stderr, "Error signaling input thread, it probably already finished\n");
   }
+  // Or it could be waiting for the paste thread to hand stdin back
+  pthread_mutex_lock(&m->paste_lock);
+  pthread_cond_broadcast(&m->paste_done);
+  pthread_mutex_unlock(&m->paste_lock);
 
   if(pthread_join(clock_thread, NULL)) {
     fprintf(stderr, "Error joining clock thread\n");
@@ -332,19 +621,27 @@ int main_loop() {
     fprintf(stderr, "Error joining input thread\n");
     return ERROR_PTHREAD_JOIN;
   }
+  if(pasting) {
+    if(pthread_join(paste_thread, NULL)) {
+      fprintf(stderr, "Error joining paste thread\n");
+      return ERROR_PTHREAD_JOIN;
+    }
+  }
+  // Whatever the guest printed last goes out before the debugger prompt
+  stop_display(&m->display);
   char input[64];
   char prev_input[64];
   memset(input, 0x00, sizeof(input));
   memset(prev_input, 0x00, sizeof(prev_input));
-  while(debug_mode) {
+  while(m->debug_mode) {
     // The main control loop ended becase a break into debugger happened,
     // we'll handle this until we resume, at which point the main control
     // loop will be restarted by the parent function
 
     // We set poweroff to false again so that the CPU can work whenever
     // we clock it manually
-    poweroff = false;
-    printf("0x%04X dbg> ", address_bus);
+    m->poweroff = false;
+    printf("0x%04X dbg> ", m->address_bus);
     char* line_read = fgets(input, 64, stdin);
     if(line_read) {
       line_read[strcspn(line_read, "\n")] = '\0';
@@ -355,7 +652,7 @@ int main_loop() {
         memcpy(prev_input, input, sizeof(input));
       }
       if(!strncmp(line_read, "next", 4) || !strncmp(line_read, "n", 1)) {
-        process_emulator_input(EMULATOR_STEP_INSTRUCTION);
+        process_emulator_input(m, EMULATOR_STEP_INSTRUCTION);
       } else if(!strncmp(line_read, "set ", 4)) {
         char* arg1 = read_arg(input);
         char* arg2 = read_arg(arg1);
@@ -365,7 +662,7 @@ int main_loop() {
           if(ret != SUCCESS) {
             printf("Invalid value specified\n");
           } else {
-            ret = set_value(&cpu, arg1, value);
+            ret = set_value(&m->cpu, arg1, value);
             if(ret != SUCCESS) {
               printf("Invalid address or register specified\n");
             }
@@ -373,10 +670,25 @@ int main_loop() {
         } else {
           printf("Missing argument\n");
         }
+      } else if(!strncmp(line_read, "save", 4) || !strncmp(line_read, "load", 4)) {
+        // Before step, as it'd also match s. Picking a slot makes it the
+        // current one for F6/F7 too
+        char* arg1 = read_arg(input);
+        if(arg1 != NULL) {
+          m->savestate_slot = strtoul(arg1, NULL, 10);
+        }
+        if(*line_read == 's') {
+          save_apple1_state(m, m->savestate_slot);
+        } else {
+          load_apple1_state(m, m->savestate_slot);
+        }
       } else if(!strncmp(line_read, "step", 4) || !strncmp(line_read, "s", 1)) {
-        process_emulator_input(EMULATOR_STEP_CLOCK);
+        process_emulator_input(m, EMULATOR_STEP_CLOCK);
+      } else if(!strncmp(line_read, "calls", 5)) {
+        // Before continue, as it'd also match c
+        print_call_profile(&m->cpu);
       } else if(!strncmp(line_read, "continue", 8) || !strncmp(line_read, "c", 1)) {
-        process_emulator_input(EMULATOR_CONTINUE);
+        process_emulator_input(m, EMULATOR_CONTINUE);
       } else if(!strncmp(line_read, "help", 4) || !strncmp(line_read, "h", 1)) {
         print_debugger_help();
       } else if(!strncmp(line_read, "breakpoint ", 11) || !strncmp(line_read, "b ", 2)) {
@@ -396,62 +708,141 @@ int main_loop() {
           if(ret != SUCCESS) {
             printf("Invalid address specified\n");
           } else {
-            print_disassembly(&cpu, addr, 10);
+            print_disassembly(&m->cpu, addr, 10);
           }
         }
       } else if(!strncmp(line_read, "print ", 6)  || !strncmp(line_read, "p ", 2)) {
         char* arg1 = read_arg(input);
         if(arg1 != NULL) {
-          int ret = print_value(&cpu, arg1);
+          int ret = print_value(&m->cpu, arg1);
           if(ret != SUCCESS) {
             printf("Invalid address or register specified\n");
           }
         } else {
           printf("Missing argument\n");
         }
+      } else if(!strncmp(line_read, "profile", 7) || !strncmp(line_read, "pf", 2)) {
+        char* arg1 = read_arg(input);
+        if(arg1 != NULL && !strncmp(arg1, "clear", 5) && m->cpu.profile != NULL) {
+          clear_profile(m->cpu.profile);
+        } else {
+          print_profile(&m->cpu);
+        }
+      } else if(!strncmp(line_read, "rewind", 6)) {
+        char* arg1 = read_arg(input);
+        unsigned int steps = arg1 != NULL ? strtoul(arg1, NULL, 10) : 1;
+        unsigned int rewound = rewind_apple1(m, steps);
+        printf("Went back %u snapshot%s\n", rewound, rewound == 1 ? "" : "s");
+        if(rewound) {
+          print_disassembly(&m->cpu, m->cpu.PC, 1);
+        }
       } else if(!strncmp(line_read, "quit", 4) || !strncmp(line_read, "q", 1)) {
         // When we exit the debug_mode loop, it'll either be with poweroff = false, because
         // a continue was called, or poweroff = true because of this break here, which will
         // cause the emulator to shut down, which is what we want
-        poweroff = true;
+        m->poweroff = true;
         break;
       } else {
         printf("Unrecognised command: %s\n", input);
       }
     } else if(feof(stdin)) {
       printf("\n");
-      poweroff = true;
-      debug_mode = false;
+      m->poweroff = true;
+      m->debug_mode = false;
     }
   }
 
   return SUCCESS;
 }
 
-int boot_apple1() {
-  init_cpu(&cpu);
+int boot_apple1(Apple1Machine* m) {
+  init_cpu(&m->cpu);
   clear_screen();
   print_greeting();
-  while(!poweroff) {
+  while(!m->poweroff) {
     init_pia();
     // This loop basically checks if we exited the main loop but poweroff is not true, so we may
     // restart it again. This would happen if we resumed from the debugger.
-    int ret = main_loop();
+    int ret = main_loop(m);
     if(ret != SUCCESS) {
       return FAILURE;
     }
   }
-  destroy_mem(&user_ram);
-  destroy_mem(&extra_ram);
-  destroy_mem(&rom);
+  if(m->cpu.crashed) {
+    // Keep whatever led to the crash around
+    save_apple1_state(m, m->savestate_slot);
+  }
+  if(m->cpu.profile != NULL) {
+    print_profile(&m->cpu);
+  }
+  if(m->cpu.call_profile != NULL) {
+    print_call_profile(&m->cpu);
+    write_folded_stacks(m->cpu.call_profile, m->folded_stacks_path);
+  }
 
   return SUCCESS;
 }
 
-void halt_apple1() {
-  if(!poweroff) {
+// TSC ticks, as the closest thing to host cycles we can read cheaply. 0 if
+// there's no such thing on this host
+static inline uint64_t host_cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+int bench_apple1(Apple1Machine* m, unsigned long long max_cycles, int stop_pc) {
+  // No terminal, no threads and no pacing, the CPU just runs on this thread.
+  // Whatever the guest prints goes to stderr, to keep stdout for the results
+  m->display.fd = STDERR_FILENO;
+  init_cpu(&m->cpu);
+  if(stop_pc >= 0) {
+    m->cpu.break_enabled = true;
+    m->cpu.break_addr = stop_pc;
+  }
+
+  struct timespec begin;
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &begin);
+  uint64_t host_begin = host_cycles();
+  run_apple1_cycles(m, max_cycles);
+  uint64_t host_end = host_cycles();
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  flush_display(&m->display);
+
+  double elapsed = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+  const char* mode = "cycle";
+  if(m->cpu.jit != NULL && m->cpu.jit->enabled) {
+    mode = "jit";
+  } else if(m->cpu.requested_mode == CPU_MODE_INSTRUCTION) {
+    mode = "instruction";
+  }
+  bool stopped = stop_pc >= 0 && m->cpu.PC == stop_pc;
+  printf("{\"mode\": \"%s\", \"cycles\": %llu, \"instructions\": %llu, \"wall_time\": %.6f, ",
+    mode, m->cpu.tick_count, m->cpu.instructions, elapsed);
+  // JSON has no inf or nan, so a run too short to time gets null
+  if(elapsed > 0) {
+    printf("\"mhz\": %.3f, ", m->cpu.tick_count / elapsed / 1e6);
+  } else {
+    printf("\"mhz\": null, ");
+  }
+  if(host_end != host_begin && m->cpu.tick_count) {
+    printf("\"host_cycles_per_cycle\": %.3f, ", (double)(host_end - host_begin) / m->cpu.tick_count);
+  } else {
+    printf("\"host_cycles_per_cycle\": null, ");
+  }
+  printf("\"pc\": %u, \"stopped\": %s}\n", m->cpu.PC, stopped ? "true" : "false");
+
+  return (stop_pc < 0 || stopped) ? SUCCESS : FAILURE;
+}
+
+void halt_apple1(Apple1Machine* m) {
+  if(!m->poweroff) {
     fprintf(stderr, "Halting CPU...\n");
   }
-  poweroff = true;
-  debug_mode = false;
+  m->poweroff = true;
+  m->debug_mode = false;
+  wake_apple1(m);
 }
@@ -21,8 +21,18 @@
 #ifndef APPLE1_H
 #define APPLE1_H
 
+#include "m6502.h"
+#include "mem.h"
+#include "bus.h"
+#include "clock.h"
+#include "pia6821.h"
+#include "scheduler.h"
+#include "display.h"
+
 #include <stdint.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
 
 #define MAX_USER_RAM 0xD010
 #define START_USER_RAM 0x0000
@@ -36,12 +46,93 @@
 #define KBDCR 0xD011
 
 #define CLOCK_SPEED 1e6
+// LDA KBDCR and BPL back to it
+#define KEYBOARD_POLL_LENGTH 5
+// Longest the clock thread stays parked without checking for control requests
+#define IDLE_PARK_TIMEOUT 10000000
 #define DEFAULT_PERF_COUNTER_FREQ 10
+#define DEFAULT_BENCH_CYCLES 100000000
+
+// A whole Apple I (or a bare 6502 with RAM all over in binary mode). Machines
+// are independent of each other, so any number of them can run in the same
+// process, as long as only one of them uses the terminal
+typedef struct Apple1Machine {
+  M6502 cpu;
+  Clock main_clock;
+  Mem_16 user_ram;
+  Mem_16 extra_ram;
+  Mem_16 rom;
+  PIA6821 pia;
+  // Decodes every access of the CPU to whatever is mapped there
+  Bus bus;
+  // What the devices have to do, and when, in CPU cycles
+  Scheduler scheduler;
+  Display display;
+
+  volatile uint16_t address_bus;
+  volatile uint8_t data_bus;
+  bool read_only;
+  volatile bool poweroff;
+  volatile bool debug_mode;
+  float emulation_speed;
+  const char* folded_stacks_path;
+  // Where F6/F7 save and load the state, see get_savestate_path
+  const char* savestate_path;
+  unsigned int savestate_slot;
+  // Snapshots to go back in time, NULL unless enabled with set_rewind
+  struct Rewind* rewind;
+  // Where the keys to paste come from, -1 if nowhere. What was read from it
+  // is kept here so that it picks up where it left off after the debugger.
+  // Accessed atomically while the threads are running
+  int paste_fd;
+  unsigned char paste_buffer[PASTE_CHUNK_SIZE];
+  size_t paste_pos;
+  size_t paste_length;
+  unsigned char paste_last;
+
+  Connected_chip cpu_callback;
+  Connected_chip bus_callback;
+  Connected_chip user_ram_callback;
+  Connected_chip extra_ram_callback;
+  Connected_chip rom_callback;
+  Connected_chip pia_callback;
+  Batch_runner apple1_runner;
+  Write_listener cpu_write_listener;
+
+  // To park the clock thread while the CPU is just waiting for a key
+  pthread_mutex_t idle_lock;
+  pthread_cond_t idle_wake;
+  // For the input thread to wait while stdin is being pasted in, signalled
+  // when the paste thread hands it back and on poweroff
+  pthread_mutex_t paste_lock;
+  pthread_cond_t paste_done;
+} Apple1Machine;
 
-int init_apple1_binary(uint8_t* binary_data, size_t binary_length, uint16_t start_addr, uint16_t load_addr);
-int init_apple1(size_t user_ram_size, uint8_t* rom_data, size_t rom_length, uint8_t* extra_data, size_t extra_length);
-int boot_apple1();
-void halt_apple1();
-void process_emulator_input(char key);
+Apple1Machine* create_apple1();
+void destroy_apple1(Apple1Machine* m);
+int init_apple1_binary(Apple1Machine* m, uint8_t* binary_data, size_t binary_length, uint16_t start_addr, uint16_t load_addr);
+int init_apple1(Apple1Machine* m, size_t user_ram_size, uint8_t* rom_data, size_t rom_length, uint8_t* extra_data, size_t extra_length);
+int boot_apple1(Apple1Machine* m);
+// Runs unpaced and headless for max_cycles or until PC gets to stop_pc (if not
+// negative), then prints the results as JSON
+int bench_apple1(Apple1Machine* m, unsigned long long max_cycles, int stop_pc);
+void halt_apple1(Apple1Machine* m);
+void process_emulator_input(Apple1Machine* m, char key);
+unsigned long long run_apple1(void* ptr, unsigned long long cycles);
+// Runs the CPU for up to cycles, stopping to run every event on the way. Stops
+// early like cpu_run_cycles does
+unsigned long long run_apple1_cycles(Apple1Machine* m, unsigned long long cycles);
+void wake_apple1(Apple1Machine* m);
+void set_instruction_mode(Apple1Machine* m, bool enabled);
+void set_jit(Apple1Machine* m, bool enabled);
+// Chars per second the display takes, like the real one did. 0 for as fast
+// as the guest writes them
+void set_display_rate(Apple1Machine* m, unsigned int rate);
+// Types in everything in the file (or stdin if "-") as fast as the guest
+// reads it
+int set_paste(Apple1Machine* m, const char* path);
+void set_profile(Apple1Machine* m, bool enabled);
+// Writes the folded guest call stacks to path on exit, NULL turns it off
+void set_call_profile(Apple1Machine* m, const char* path);
 
 #endif
@@ -0,0 +1,405 @@
+/***************************************************************************
+ *   batch.c  --  This file is part of apple1emu.                          *
+ *                                                                         *
+ *   Copyright (C) 2021 Imanol-Mikel Barba Sabariego                       *
+ *                                                                         *
+ *   apple1emu is free software: you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published     *
+ *   by the Free Software Foundation, either version 3 of the License,     *
+ *   or (at your option) any later version.                                *
+ *                                                                         *
+ *   apple1emu is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty           *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.               *
+ *   See the GNU General Public License for more details.                  *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "batch.h"
+#include "m6502_instr.h"
+#include "errors.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+// Jobs handed to a worker. The owner takes them from the tail, idle workers
+// steal them from the head
+typedef struct {
+  pthread_mutex_t lock;
+  unsigned int* jobs;
+  unsigned int head;
+  unsigned int tail;
+} Job_queue;
+
+typedef struct {
+  Batch_job* jobs;
+  Job_queue* queues;
+  unsigned int num_queues;
+  bool fast;
+  bool jit;
+} Batch;
+
+typedef struct {
+  Batch* batch;
+  unsigned int index;
+} Worker;
+
+// Whatever a job writes goes through here, so it still has to drop the
+// decoded instructions
+typedef struct {
+  Apple1Machine* machine;
+  Batch_job* job;
+} Output_capture;
+
+static const char* job_status_names[] = {
+  [JOB_PENDING] = "pending",
+  [JOB_STOPPED] = "stopped",
+  [JOB_TRAPPED] = "trapped",
+  [JOB_BUDGET] = "budget",
+  [JOB_CRASHED] = "crashed",
+  [JOB_ERROR] = "error"
+};
+
+void capture_output(void* ptr, uint16_t addr) {
+  Output_capture* capture = (Output_capture*)ptr;
+  Mem_16* ram = &capture->machine->user_ram;
+  invalidate_decoded(&capture->machine->cpu, addr);
+  Batch_job* job = capture->job;
+  if(addr != job->out_addr || job->output_length == BATCH_MAX_OUTPUT) {
+    return;
+  }
+  if(job->output == NULL) {
+    job->output = malloc(BATCH_MAX_OUTPUT);
+    if(job->output == NULL) {
+      return;
+    }
+  }
+  job->output[job->output_length++] = ram->mem[addr - ram->start_addr];
+}
+
+int read_binary(const char* path, uint8_t** data) {
+  FILE* f = fopen(path, "rb");
+  if(f == NULL) {
+    fprintf(stderr, "Error opening file: %s\n", path);
+    return ERROR_OPEN_FILE;
+  }
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  *data = malloc(size > 0 ? size : 1);
+  if(*data == NULL || size < 0 || fread(*data, 1, size, f) != (size_t)size) {
+    fprintf(stderr, "Error reading file: %s\n", path);
+    free(*data);
+    fclose(f);
+    return ERROR_READ_FILE;
+  }
+  fclose(f);
+  return size;
+}
+
+// JMP or a branch to itself, which is how test suites usually stop
+bool is_trapped(Mem_16* ram, uint16_t pc) {
+  uint8_t opcode = ram->mem[pc];
+  if(opcode == 0x4C) {
+    return ram->mem[(uint16_t)(pc + 1)] == (pc & 0xFF) && ram->mem[(uint16_t)(pc + 2)] == pc >> 8;
+  }
+  // Conditional branches are all xxx10000
+  return (opcode & 0x1F) == 0x10 && ram->mem[(uint16_t)(pc + 1)] == 0xFE;
+}
+
+void run_job(Batch* batch, Batch_job* job) {
+  uint8_t* data = NULL;
+  int length = read_binary(job->path, &data);
+  Apple1Machine* m = length < 0 ? NULL : create_apple1();
+  if(m == NULL || init_apple1_binary(m, data, length, job->start_addr, job->load_addr) != SUCCESS) {
+    job->status = JOB_ERROR;
+    free(data);
+    destroy_apple1(m);
+    return;
+  }
+  free(data);
+
+  Output_capture capture = {
+    .machine = m,
+    .job = job,
+  };
+  Write_listener output_listener = {
+    .callback = &capture_output,
+    .listener = &capture,
+  };
+  if(job->out_addr >= 0) {
+    m->user_ram.write_listener = &output_listener;
+  }
+  M6502* cpu = &m->cpu;
+  init_cpu(cpu);
+  set_instruction_mode(m, batch->fast);
+  if(batch->jit) {
+    set_jit(m, true);
+  }
+  if(job->stop_pc >= 0) {
+    cpu->break_enabled = true;
+    cpu->break_addr = job->stop_pc;
+  }
+
+  job->status = JOB_BUDGET;
+  uint16_t last_pc = cpu->PC;
+  while(cpu->tick_count < job->cycles) {
+    unsigned long long left = job->cycles - cpu->tick_count;
+    run_apple1_cycles(m, left < BATCH_QUANTUM ? left : BATCH_QUANTUM);
+    // Finish the instruction, so the registers are all up to date
+    while(!cpu->SYNC && !m->poweroff) {
+      run_apple1_cycles(m, 1);
+    }
+    if(m->poweroff) {
+      job->status = JOB_CRASHED;
+      break;
+    }
+    if(job->stop_pc >= 0 && cpu->PC == job->stop_pc) {
+      job->status = JOB_STOPPED;
+      break;
+    }
+    // Still on the same instruction a whole quantum later
+    if(job->stop_on_trap && cpu->PC == last_pc && is_trapped(&m->user_ram, cpu->PC)) {
+      job->status = JOB_TRAPPED;
+      break;
+    }
+    last_pc = cpu->PC;
+  }
+
+  job->PC = cpu->PC;
+  job->A = cpu->A;
+  job->X = cpu->X;
+  job->Y = cpu->Y;
+  job->S = cpu->S;
+  job->P = cpu->status;
+  job->cycles_run = cpu->tick_count;
+  job->instructions = cpu->instructions;
+  destroy_apple1(m);
+}
+
+bool take_job(Job_queue* queue, bool steal, unsigned int* job) {
+  pthread_mutex_lock(&queue->lock);
+  bool taken = queue->head != queue->tail;
+  if(taken) {
+    *job = steal ? queue->jobs[queue->head++] : queue->jobs[--queue->tail];
+  }
+  pthread_mutex_unlock(&queue->lock);
+  return taken;
+}
+
+void* batch_worker(void* ptr) {
+  Worker* w = (Worker*)ptr;
+  Batch* batch = w->batch;
+  unsigned int job;
+  while(true) {
+    bool found = take_job(&batch->queues[w->index], false, &job);
+    for(unsigned int i = 1; !found && i < batch->num_queues; ++i) {
+      found = take_job(&batch->queues[(w->index + i) % batch->num_queues], true, &job);
+    }
+    if(!found) {
+      // No job is ever queued once they've started, so we're done
+      break;
+    }
+    run_job(batch, &batch->jobs[job]);
+  }
+  return NULL;
+}
+
+int parse_job(char* line, Batch_job* job) {
+  memset(job, 0, sizeof(Batch_job));
+  job->cycles = DEFAULT_BENCH_CYCLES;
+  job->stop_pc = -1;
+  job->out_addr = -1;
+  char* save;
+  char* path = strtok_r(line, " \t", &save);
+  char* load = strtok_r(NULL, " \t", &save);
+  char* start = strtok_r(NULL, " \t", &save);
+  if(path == NULL || load == NULL || start == NULL) {
+    return FAILURE;
+  }
+  job->path = strdup(path);
+  job->load_addr = strtol(load, NULL, 0);
+  job->start_addr = strtol(start, NULL, 0);
+  char* option;
+  while((option = strtok_r(NULL, " \t", &save)) != NULL) {
+    if(!strncmp(option, "cycles=", 7)) {
+      job->cycles = strtoull(option + 7, NULL, 0);
+    } else if(!strcmp(option, "stop=trap")) {
+      job->stop_on_trap = true;
+    } else if(!strncmp(option, "stop=", 5)) {
+      job->stop_pc = strtol(option + 5, NULL, 0) & 0xFFFF;
+    } else if(!strncmp(option, "out=", 4)) {
+      job->out_addr = strtol(option + 4, NULL, 0) & 0xFFFF;
+    } else {
+      return FAILURE;
+    }
+  }
+  return job->path != NULL ? SUCCESS : ERROR_MEMORY_ALLOC;
+}
+
+int read_manifest(const char* path, Batch_job** jobs) {
+  FILE* f = fopen(path, "r");
+  if(f == NULL) {
+    fprintf(stderr, "Error opening file: %s\n", path);
+    return ERROR_OPEN_FILE;
+  }
+  char line[BATCH_MAX_LINE];
+  unsigned int num_jobs = 0;
+  unsigned int max_jobs = 0;
+  unsigned int line_number = 0;
+  *jobs = NULL;
+  while(fgets(line, sizeof(line), f) != NULL) {
+    line_number++;
+    line[strcspn(line, "\r\n#")] = '\0';
+    if(line[strspn(line, " \t")] == '\0') {
+      // Blank or just a comment
+      continue;
+    }
+    if(num_jobs == max_jobs) {
+      max_jobs = max_jobs ? 2 * max_jobs : 64;
+      Batch_job* grown = realloc(*jobs, max_jobs * sizeof(Batch_job));
+      if(grown == NULL) {
+        fprintf(stderr, "Unable to alloc batch jobs\n");
+        for(unsigned int i = 0; i < num_jobs; ++i) {
+          free((*jobs)[i].path);
+        }
+        free(*jobs);
+        fclose(f);
+        return ERROR_MEMORY_ALLOC;
+      }
+      *jobs = grown;
+    }
+    if(parse_job(line, &(*jobs)[num_jobs]) != SUCCESS) {
+      fprintf(stderr, "Invalid job at %s:%u\n", path, line_number);
+      for(unsigned int i = 0; i <= num_jobs; ++i) {
+        free((*jobs)[i].path);
+      }
+      free(*jobs);
+      fclose(f);
+      return FAILURE;
+    }
+    num_jobs++;
+  }
+  fclose(f);
+  return num_jobs;
+}
+
+void write_escaped(FILE* f, const char* data, size_t length) {
+  for(size_t i = 0; i < length; ++i) {
+    unsigned char c = data[i];
+    if(c == '"' || c == '\\') {
+      fprintf(f, "\\%c", c);
+    } else if(c < 0x20 || c >= 0x7F) {
+      fprintf(f, "\\u%04X", c);
+    } else {
+      fputc(c, f);
+    }
+  }
+}
+
+int write_results(const char* path, Batch_job* jobs, unsigned int num_jobs) {
+  FILE* f = strcmp(path, "-") ? fopen(path, "w") : stdout;
+  if(f == NULL) {
+    fprintf(stderr, "Error opening file: %s\n", path);
+    return ERROR_OPEN_FILE;
+  }
+  for(unsigned int i = 0; i < num_jobs; ++i) {
+    Batch_job* job = &jobs[i];
+    fprintf(f, "{\"path\": \"");
+    write_escaped(f, job->path, strlen(job->path));
+    fprintf(f, "\", \"status\": \"%s\", \"cycles\": %llu, \"instructions\": %llu, ",
+      job_status_names[job->status], job->cycles_run, job->instructions);
+    fprintf(f, "\"PC\": %u, \"A\": %u, \"X\": %u, \"Y\": %u, \"S\": %u, \"P\": %u, \"output\": \"",
+      job->PC, job->A, job->X, job->Y, job->S, job->P);
+    write_escaped(f, job->output, job->output_length);
+    fprintf(f, "\"}\n");
+  }
+  if(f != stdout && fclose(f)) {
+    fprintf(stderr, "Error writing file: %s\n", path);
+    return ERROR_WRITE_FILE;
+  }
+  return SUCCESS;
+}
+
+int run_batch(const char* manifest_path, const char* results_path, unsigned int threads, bool fast, bool jit) {
+  Batch batch = {
+    .fast = fast,
+    .jit = jit,
+  };
+  int num_jobs = read_manifest(manifest_path, &batch.jobs);
+  if(num_jobs < 0) {
+    return num_jobs;
+  }
+  if(!threads) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = cores > 0 ? cores : 1;
+  }
+  if(threads > (unsigned int)num_jobs) {
+    threads = num_jobs ? num_jobs : 1;
+  }
+
+  // Every worker starts with its share of the jobs, in order
+  int ret = SUCCESS;
+  batch.num_queues = threads;
+  batch.queues = calloc(threads, sizeof(Job_queue));
+  unsigned int* job_indices = malloc((num_jobs ? num_jobs : 1) * sizeof(unsigned int));
+  Worker* workers = calloc(threads, sizeof(Worker));
+  pthread_t* worker_threads = calloc(threads, sizeof(pthread_t));
+  unsigned int started = 0;
+  if(batch.queues == NULL || job_indices == NULL || workers == NULL || worker_threads == NULL) {
+    fprintf(stderr, "Unable to alloc batch workers\n");
+    ret = ERROR_MEMORY_ALLOC;
+  } else {
+    for(int i = 0; i < num_jobs; ++i) {
+      job_indices[i] = i;
+    }
+    for(unsigned int i = 0; i < threads; ++i) {
+      Job_queue* queue = &batch.queues[i];
+      pthread_mutex_init(&queue->lock, NULL);
+      queue->jobs = job_indices;
+      queue->head = (unsigned long long)num_jobs * i / threads;
+      queue->tail = (unsigned long long)num_jobs * (i + 1) / threads;
+      workers[i].batch = &batch;
+      workers[i].index = i;
+    }
+    // If some of them can't be started the rest just steal their jobs
+    for(; started < threads; ++started) {
+      if(pthread_create(&worker_threads[started], NULL, batch_worker, &workers[started])) {
+        fprintf(stderr, "Error creating thread\n");
+        break;
+      }
+    }
+    if(!started) {
+      ret = ERROR_PTHREAD_CREATE;
+    }
+  }
+  for(unsigned int i = 0; i < started; ++i) {
+    if(pthread_join(worker_threads[i], NULL)) {
+      fprintf(stderr, "Error joining batch thread\n");
+      ret = ERROR_PTHREAD_JOIN;
+    }
+  }
+  if(ret == SUCCESS) {
+    ret = write_results(results_path, batch.jobs, num_jobs);
+  }
+
+  for(unsigned int i = 0; ret != ERROR_MEMORY_ALLOC && i < threads; ++i) {
+    pthread_mutex_destroy(&batch.queues[i].lock);
+  }
+  for(int i = 0; i < num_jobs; ++i) {
+    free(batch.jobs[i].path);
+    free(batch.jobs[i].output);
+  }
+  free(batch.jobs);
+  free(batch.queues);
+  free(job_indices);
+  free(workers);
+  free(worker_threads);
+  return ret;
+}
@@ -0,0 +1,75 @@
+/***************************************************************************
+ *   batch.h  --  This file is part of apple1emu.                          *
+ *                                                                         *
+ *   Copyright (C) 2021 Imanol-Mikel Barba Sabariego                       *
+ *                                                                         *
+ *   apple1emu is free software: you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published     *
+ *   by the Free Software Foundation, either version 3 of the License,     *
+ *   or (at your option) any later version.                                *
+ *                                                                         *
+ *   apple1emu is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty           *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.               *
+ *   See the GNU General Public License for more details.                  *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "apple1.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Cycles run between checks for the guest trapping itself
+#define BATCH_QUANTUM 10000
+// Output captured per job, anything past this is dropped
+#define BATCH_MAX_OUTPUT 0x10000
+#define BATCH_MAX_LINE 1024
+
+enum job_status {
+  JOB_PENDING = 0,
+  JOB_STOPPED = 1, // Got to the stop address
+  JOB_TRAPPED = 2, // Jumping or branching to itself
+  JOB_BUDGET = 3,  // Ran out of cycles
+  JOB_CRASHED = 4,
+  JOB_ERROR = 5    // Couldn't even start
+};
+
+// One line of the manifest: PATH LOAD_ADDR START_ADDR [cycles=N]
+// [stop=ADDR|trap] [out=ADDR]. Writes to the out address are what the job
+// prints
+typedef struct {
+  char* path;
+  uint16_t load_addr;
+  uint16_t start_addr;
+  unsigned long long cycles;
+  int stop_pc;
+  bool stop_on_trap;
+  int out_addr;
+
+  enum job_status status;
+  uint16_t PC;
+  uint8_t A;
+  uint8_t X;
+  uint8_t Y;
+  uint8_t S;
+  uint8_t P;
+  unsigned long long cycles_run;
+  unsigned long long instructions;
+  char* output;
+  size_t output_length;
+} Batch_job;
+
+// Runs every job in the manifest as a binary on its own machine, unpaced and
+// headless, spread over threads (or as many as host cores if 0), and writes
+// the final registers, cycles and output of each one as a line of JSON to
+// results_path (stdout if "-"), in the same order as the manifest
+int run_batch(const char* manifest_path, const char* results_path, unsigned int threads, bool fast, bool jit);
+
+#endif
@@ -0,0 +1,104 @@
+/***************************************************************************
+ *   dispatch.c  --  This file is part of apple1emu.                       *
+ *                                                                         *
+ *   Copyright (C) 2021 Imanol-Mikel Barba Sabariego                       *
+ *                                                                         *
+ *   apple1emu is free software: you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published     *
+ *   by the Free Software Foundation, either version 3 of the License,     *
+ *   or (at your option) any later version.                                *
+ *                                                                         *
+ *   apple1emu is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty           *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.               *
+ *   See the GNU General Public License for more details.                  *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.   *
+ *                                                                         *
+ ***************************************************************************/
+
+// Runs the Klaus2m5 6502 functional test binary headless and unpaced, to
+// compare the opcode dispatch strategies of the cycle-stepped core. Every
+// strategy is built into its own executable (see CMakeLists.txt).
+
+#include "../apple1.h"
+#include "../m6502.h"
+#include "../m6502_instr.h"
+#include "../errors.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define FUNCTIONAL_TEST_LOAD_ADDR 0x000A
+#define FUNCTIONAL_TEST_START_ADDR 0x0400
+#define FUNCTIONAL_TEST_SUCCESS_ADDR 0x3469
+// It takes a bit over 96M cycles to pass
+#define FUNCTIONAL_TEST_MAX_CYCLES 100000000
+
+#if defined(DISPATCH_SWITCH)
+#define DISPATCH_NAME "switch"
+#else
+#define DISPATCH_NAME "table"
+#endif
+
+int main(int argc, char** argv) {
+  if(argc < 2) {
+    fprintf(stderr, "%s FUNCTIONAL_TEST_BINARY [-f | -j]\n", argv[0]);
+    return FAILURE;
+  }
+  bool jit = argc > 2 && !strcmp(argv[2], "-j");
+  bool fast = jit || (argc > 2 && !strcmp(argv[2], "-f"));
+
+  struct stat st;
+  if(stat(argv[1], &st) == -1) {
+    fprintf(stderr, "Error opening file: %s\n", argv[1]);
+    return ERROR_OPEN_FILE;
+  }
+  uint8_t* data = malloc(st.st_size);
+  int fd = open(argv[1], O_RDONLY);
+  if(data == NULL || fd == -1 || read(fd, data, st.st_size) != st.st_size) {
+    fprintf(stderr, "Error reading file: %s\n", argv[1]);
+    return ERROR_READ_FILE;
+  }
+  close(fd);
+
+  Apple1Machine* m = create_apple1();
+  if(m == NULL || init_apple1_binary(m, data, st.st_size, FUNCTIONAL_TEST_START_ADDR, FUNCTIONAL_TEST_LOAD_ADDR) != SUCCESS) {
+    return FAILURE;
+  }
+  M6502* cpu = &m->cpu;
+  init_cpu(cpu);
+  set_instruction_mode(m, fast);
+  if(jit) {
+    set_jit(m, true);
+  }
+
+  struct timespec begin;
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &begin);
+  // The test traps on an instruction jumping to itself, both on success and
+  // failure. Failures are caught by running out of cycles
+  cpu->break_enabled = true;
+  cpu->break_addr = FUNCTIONAL_TEST_SUCCESS_ADDR;
+  cpu_run_cycles(cpu, FUNCTIONAL_TEST_MAX_CYCLES);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  double elapsed = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+  printf("%-8s %-11s %s at 0x%04X: %llu cycles in %.3fs, %.2f MHz\n",
+    DISPATCH_NAME, jit ? "jit" : (fast ? "instruction" : "cycle"),
+    cpu->PC == FUNCTIONAL_TEST_SUCCESS_ADDR ? "PASS" : "FAIL", cpu->PC,
+    cpu->tick_count, elapsed, cpu->tick_count / elapsed / 1e6);
+  if(fast) {
+    print_fusion_stats(cpu);
+  }
+  bool passed = cpu->PC == FUNCTIONAL_TEST_SUCCESS_ADDR;
+  destroy_apple1(m);
+  free(data);
+  return passed ? SUCCESS : FAILURE;
+}
@@ -0,0 +1,339 @@
+/***************************************************************************
+ *   micro.c  --  This file is part of apple1emu.                          *
+ *                                                                         *
+ *   Copyright (C) 2021 Imanol-Mikel Barba Sabariego                       *
+ *                                                                         *
+ *   apple1emu is free software: you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published     *
+ *   by the Free Software Foundation, either version 3 of the License,     *
+ *   or (at your option) any later version.                                *
+ *                                                                         *
+ *   apple1emu is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty           *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.               *
+ *   See the GNU General Public License for more details.                  *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.   *
+ *                                                                         *
+ ***************************************************************************/
+
+// Microbenchmarks for the hot paths of the core, one at a time, so that a
+// regression in any of them shows up on its own instead of being averaged
+// into the MHz of a whole run. Every benchmark is warmed up and then repeated,
+// the best and median times per operation are reported.
+
+#include "../m6502.h"
+#include "../mem.h"
+#include "../pia6821.h"
+#include "../clock.h"
+#include "../bus.h"
+#include "../apple1.h"
+#include "../errors.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define WARMUP_ITERATIONS 1000000
+#define ITERATIONS 10000000
+#define REPETITIONS 7
+
+typedef void (*bench_func)(unsigned long long iterations);
+typedef struct {
+  const char* name;
+  bench_func run;
+} Microbench;
+
+static volatile uint16_t bench_addr_bus;
+static volatile uint8_t bench_data_bus;
+static bool bench_RW = true;
+static M6502 bench_cpu;
+static Mem_16 bench_ram;
+static Mem_16 bench_extra;
+static Mem_16 bench_rom;
+static PIA6821 bench_pia;
+static Scheduler bench_scheduler;
+static Display bench_display;
+static Clock bench_clock;
+static Bus bench_bus;
+static Clock bench_bus_clock;
+
+static Connected_chip bench_ram_callback = {
+  .callback = &clock_mem,
+  .chip = &bench_ram,
+};
+static Connected_chip bench_extra_callback = {
+  .callback = &clock_mem,
+  .chip = &bench_extra,
+};
+static Connected_chip bench_rom_callback = {
+  .callback = &clock_mem,
+  .chip = &bench_rom,
+};
+// Without the bus, the PIA has to be told which accesses are for it
+static void clock_decoded_pia(void* ptr, bool status) {
+  if(bench_addr_bus >= KBD && bench_addr_bus <= DSPCR) {
+    clock_pia(ptr, status);
+  }
+}
+
+static Connected_chip bench_pia_callback = {
+  .callback = &clock_pia,
+  .chip = &bench_pia,
+};
+static Connected_chip bench_decoded_pia_callback = {
+  .callback = &clock_decoded_pia,
+  .chip = &bench_pia,
+};
+static Connected_chip bench_bus_callback = {
+  .callback = &clock_bus,
+  .chip = &bench_bus,
+};
+
+// Runs every stage of an addressing mode helper, as the opcode would
+static inline void run_addressing(uint8_t opcode, unsigned int stages, void (*helper)(M6502*), unsigned long long iterations) {
+  for(unsigned long long i = 0; i < iterations; ++i) {
+    bench_cpu.PC = 0x0200;
+    bench_data_bus = i;
+    for(unsigned int stage = 0; stage < stages; ++stage) {
+      bench_cpu.IR = opcode << 3 | stage;
+      helper(&bench_cpu);
+    }
+  }
+}
+
+static void zero_page_x(M6502* cpu) {
+  get_arg_zero_page_index(cpu, cpu->X);
+}
+
+static void absolute_x(M6502* cpu) {
+  get_arg_absolute_index(cpu, cpu->X);
+}
+
+void bench_indirect_index(unsigned long long iterations) {
+  // LDA (ind),Y
+  run_addressing(0xB1, 5, &get_arg_indirect_index, iterations);
+}
+
+void bench_index_indirect(unsigned long long iterations) {
+  // LDA (ind,X)
+  run_addressing(0xA1, 5, &get_arg_index_indirect, iterations);
+}
+
+void bench_zero_page(unsigned long long iterations) {
+  // LDA zpg
+  run_addressing(0xA5, 2, &get_arg_zero_page, iterations);
+}
+
+void bench_zero_page_index(unsigned long long iterations) {
+  // LDA zpg,X
+  run_addressing(0xB5, 3, &zero_page_x, iterations);
+}
+
+void bench_absolute(unsigned long long iterations) {
+  // LDA abs
+  run_addressing(0xAD, 3, &get_arg_absolute, iterations);
+}
+
+void bench_absolute_index(unsigned long long iterations) {
+  // LDA abs,X
+  run_addressing(0xBD, 4, &absolute_x, iterations);
+}
+
+static inline void run_arithmetic(void (*op)(M6502*), bool decimal, unsigned long long iterations) {
+  if(decimal) {
+    bench_cpu.status |= STATUS_DF;
+  } else {
+    bench_cpu.status &= ~STATUS_DF;
+  }
+  for(unsigned long long i = 0; i < iterations; ++i) {
+    bench_data_bus = i;
+    op(&bench_cpu);
+  }
+}
+
+void bench_adc_binary(unsigned long long iterations) {
+  run_arithmetic(&do_ADC, false, iterations);
+}
+
+void bench_adc_decimal(unsigned long long iterations) {
+  run_arithmetic(&do_ADC, true, iterations);
+}
+
+void bench_sbc_binary(unsigned long long iterations) {
+  run_arithmetic(&do_SBC, false, iterations);
+}
+
+void bench_sbc_decimal(unsigned long long iterations) {
+  run_arithmetic(&do_SBC, true, iterations);
+}
+
+void bench_clock_mem_read(unsigned long long iterations) {
+  bench_RW = true;
+  for(unsigned long long i = 0; i < iterations; ++i) {
+    bench_addr_bus = i;
+    clock_mem(&bench_ram, true);
+  }
+}
+
+void bench_clock_mem_write(unsigned long long iterations) {
+  bench_RW = false;
+  for(unsigned long long i = 0; i < iterations; ++i) {
+    bench_addr_bus = i;
+    clock_mem(&bench_ram, true);
+  }
+  bench_RW = true;
+}
+
+void bench_clock_mem_miss(unsigned long long iterations) {
+  // Addresses outside of the ROM, like most of the accesses it sees
+  for(unsigned long long i = 0; i < iterations; ++i) {
+    bench_addr_bus = i & 0x7FFF;
+    clock_mem(&bench_rom, true);
+  }
+}
+
+void bench_clock_pia_idle(unsigned long long iterations) {
+  // What the clock used to pay for the PIA on every other access
+  for(unsigned long long i = 0; i < iterations; ++i) {
+    bench_addr_bus = i & 0x7FFF;
+    clock_decoded_pia(&bench_pia, true);
+  }
+}
+
+void bench_clock_pia_register(unsigned long long iterations) {
+  bench_addr_bus = KBDCR;
+  for(unsigned long long i = 0; i < iterations; ++i) {
+    clock_pia(&bench_pia, true);
+  }
+}
+
+void bench_tick_tock(unsigned long long iterations) {
+  // Same chips as the phi2 bus of the Apple I, and a full cycle per operation
+  for(unsigned long long i = 0; i < iterations; ++i) {
+    bench_addr_bus = i;
+    tick(&bench_clock);
+    tock(&bench_clock);
+  }
+}
+
+void bench_tick_tock_bus(unsigned long long iterations) {
+  // Same chips, mapped on the bus instead
+  for(unsigned long long i = 0; i < iterations; ++i) {
+    bench_addr_bus = i;
+    tick(&bench_bus_clock);
+    tock(&bench_bus_clock);
+  }
+}
+
+Microbench benchmarks[] = {
+  {"get_arg_indirect_index", &bench_indirect_index},
+  {"get_arg_index_indirect", &bench_index_indirect},
+  {"get_arg_zero_page", &bench_zero_page},
+  {"get_arg_zero_page_index", &bench_zero_page_index},
+  {"get_arg_absolute", &bench_absolute},
+  {"get_arg_absolute_index", &bench_absolute_index},
+  {"adc_binary", &bench_adc_binary},
+  {"adc_decimal", &bench_adc_decimal},
+  {"sbc_binary", &bench_sbc_binary},
+  {"sbc_decimal", &bench_sbc_decimal},
+  {"clock_mem_read", &bench_clock_mem_read},
+  {"clock_mem_write", &bench_clock_mem_write},
+  {"clock_mem_miss", &bench_clock_mem_miss},
+  {"clock_pia_idle", &bench_clock_pia_idle},
+  {"clock_pia_register", &bench_clock_pia_register},
+  {"tick_tock_4_chips", &bench_tick_tock},
+  {"tick_tock_bus", &bench_tick_tock_bus},
+};
+
+int compare_times(const void* a, const void* b) {
+  double time_a = *(const double*)a;
+  double time_b = *(const double*)b;
+  return (time_a > time_b) - (time_a < time_b);
+}
+
+int setup() {
+  bench_cpu.addr_bus = &bench_addr_bus;
+  bench_cpu.data_bus = &bench_data_bus;
+  bench_cpu.X = 0x80;
+  bench_cpu.Y = 0x80;
+
+  if(init_mem(&bench_ram, 0x0000, 0xFFFF) != SUCCESS || init_mem(&bench_extra, START_EXTRA_RAM, END_EXTRA_RAM) != SUCCESS ||
+     init_mem(&bench_rom, START_ROM, END_ROM) != SUCCESS) {
+    return FAILURE;
+  }
+  bench_ram.addr_bus = &bench_addr_bus;
+  bench_ram.data_bus = &bench_data_bus;
+  bench_ram.RW = &bench_RW;
+  bench_extra.addr_bus = &bench_addr_bus;
+  bench_extra.data_bus = &bench_data_bus;
+  bench_extra.RW = &bench_RW;
+  bench_rom.addr_bus = &bench_addr_bus;
+  bench_rom.data_bus = &bench_data_bus;
+  bench_rom.RW = &bench_RW;
+
+  bench_pia.addr_bus = &bench_addr_bus;
+  bench_pia.data_bus = &bench_data_bus;
+  bench_pia.RW = &bench_RW;
+  init_scheduler(&bench_scheduler, &bench_cpu.tick_count, NULL);
+  bench_pia.scheduler = &bench_scheduler;
+  init_keyboard(&bench_pia.keyboard);
+  init_display(&bench_display, STDOUT_FILENO);
+  bench_pia.display = &bench_display;
+  bench_pia.display_cycles = DISPLAY_LATENCY;
+
+  init_clock(&bench_clock, CLOCK_SPEED);
+  if(clock_connect(&bench_clock, &bench_ram_callback) != SUCCESS ||
+     clock_connect(&bench_clock, &bench_extra_callback) != SUCCESS ||
+     clock_connect(&bench_clock, &bench_rom_callback) != SUCCESS ||
+     clock_connect(&bench_clock, &bench_decoded_pia_callback) != SUCCESS) {
+    return FAILURE;
+  }
+
+  init_bus(&bench_bus, &bench_addr_bus, &bench_data_bus, &bench_RW);
+  init_clock(&bench_bus_clock, CLOCK_SPEED);
+  if(bus_map_mem(&bench_bus, &bench_extra, true, &bench_extra_callback) != SUCCESS ||
+     bus_map_mem(&bench_bus, &bench_rom, false, &bench_rom_callback) != SUCCESS ||
+     bus_map_device(&bench_bus, KBD, DSPCR, &bench_pia_callback) != SUCCESS ||
+     bus_map_mem(&bench_bus, &bench_ram, true, &bench_ram_callback) != SUCCESS ||
+     clock_connect(&bench_bus_clock, &bench_bus_callback) != SUCCESS) {
+    return FAILURE;
+  }
+  return SUCCESS;
+}
+
+int main(int argc, char** argv) {
+  // Only the ones with this in their name, if given
+  const char* filter = argc > 1 ? argv[1] : NULL;
+  if(setup() != SUCCESS) {
+    return FAILURE;
+  }
+
+  printf("%-24s %10s %10s\n", "BENCHMARK", "BEST ns/op", "MEDIAN");
+  for(unsigned int i = 0; i < sizeof(benchmarks) / sizeof(Microbench); ++i) {
+    Microbench* b = &benchmarks[i];
+    if(filter != NULL && strstr(b->name, filter) == NULL) {
+      continue;
+    }
+    b->run(WARMUP_ITERATIONS);
+    double times[REPETITIONS];
+    for(unsigned int rep = 0; rep < REPETITIONS; ++rep) {
+      struct timespec begin;
+      struct timespec end;
+      clock_gettime(CLOCK_MONOTONIC, &begin);
+      b->run(ITERATIONS);
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      times[rep] = ((end.tv_sec - begin.tv_sec) * 1e9 + (end.tv_nsec - begin.tv_nsec)) / ITERATIONS;
+    }
+    qsort(times, REPETITIONS, sizeof(double), compare_times);
+    printf("%-24s %10.2f %10.2f\n", b->name, times[0], times[REPETITIONS / 2]);
+  }
+
+  destroy_mem(&bench_ram);
+  destroy_mem(&bench_extra);
+  destroy_mem(&bench_rom);
+  return SUCCESS;
+}
@@ -0,0 +1,97 @@
+/***************************************************************************
+ *   bus.c  --  This file is part of apple1emu.                            *
+ *                                                                         *
+ *   Copyright (C) 2021 Imanol-Mikel Barba Sabariego                       *
+ *                                                                         *
+ *   apple1emu is free software: you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published     *
+ *   by the Free Software Foundation, either version 3 of the License,     *
+ *   or (at your option) any later version.                                *
+ *                                                                         *
+ *   apple1emu is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty           *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.               *
+ *   See the GNU General Public License for more details.                  *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "bus.h"
+#include "errors.h"
+
+#include <stdio.h>
+#include <string.h>
+
+void init_bus(Bus* b, volatile uint16_t* addr_bus, volatile uint8_t* data_bus, bool* RW) {
+  memset(b->pages, 0x00, sizeof(b->pages));
+  b->addr_bus = addr_bus;
+  b->data_bus = data_bus;
+  b->RW = RW;
+}
+
+int bus_map_device(Bus* b, uint16_t start, uint16_t end, Connected_chip* chip) {
+  for(unsigned int page = start >> MEM_PAGE_SHIFT; page <= (unsigned int)(end >> MEM_PAGE_SHIFT); ++page) {
+    Bus_page* p = &b->pages[page];
+    if(p->num_devices == BUS_PAGE_DEVICES) {
+      fprintf(stderr, "Too many chips on page 0x%02X\n", page);
+      return ERROR_TOO_MANY_CHIPS_ON_PAGE;
+    }
+    Bus_device* d = &p->devices[p->num_devices++];
+    d->chip = chip;
+    d->start = start;
+    d->end = end;
+  }
+  return SUCCESS;
+}
+
+int bus_map_mem(Bus* b, Mem_16* m, bool writable, Connected_chip* chip) {
+  for(unsigned int page = m->start_addr >> MEM_PAGE_SHIFT; page <= (unsigned int)(m->end_addr >> MEM_PAGE_SHIFT); ++page) {
+    unsigned int page_start = page << MEM_PAGE_SHIFT;
+    unsigned int page_end = page_start + (1 << MEM_PAGE_SHIFT) - 1;
+    Bus_page* p = &b->pages[page];
+    if(page_start >= m->start_addr && page_end <= m->end_addr && p->mem == NULL && !p->num_devices) {
+      p->mem = m->mem + (page_start - m->start_addr);
+      p->owner = m;
+      p->writable = writable;
+    } else {
+      // Just the part of the page it covers
+      int ret = bus_map_device(b, page_start > m->start_addr ? page_start : m->start_addr,
+                               page_end < m->end_addr ? page_end : m->end_addr, chip);
+      if(ret != SUCCESS) {
+        return ret;
+      }
+    }
+  }
+  return SUCCESS;
+}
+
+void clock_bus(void* ptr, bool status) {
+  Bus* b = (Bus*)ptr;
+  if(!status) {
+    // Everything happens on the rising edge
+    return;
+  }
+  uint16_t addr = *b->addr_bus;
+  Bus_page* p = &b->pages[addr >> MEM_PAGE_SHIFT];
+  if(p->mem != NULL) {
+    uint8_t* cell = p->mem + (addr & ((1 << MEM_PAGE_SHIFT) - 1));
+    if(*b->RW) {
+      *b->data_bus = *cell;
+    } else if(p->writable) {
+      *cell = *b->data_bus;
+      mark_dirty(p->owner, addr);
+      if(p->owner->write_listener != NULL) {
+        (*p->owner->write_listener->callback)(p->owner->write_listener->listener, addr);
+      }
+    }
+    return;
+  }
+  for(unsigned int i = 0; i < p->num_devices; ++i) {
+    Bus_device* d = &p->devices[i];
+    if(addr >= d->start && addr <= d->end) {
+      (*d->chip->callback)(d->chip->chip, true);
+    }
+  }
+}
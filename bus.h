@@ -0,0 +1,68 @@
+/***************************************************************************
+ *   bus.h  --  This file is part of apple1emu.                            *
+ *                                                                         *
+ *   Copyright (C) 2021 Imanol-Mikel Barba Sabariego                       *
+ *                                                                         *
+ *   apple1emu is free software: you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published     *
+ *   by the Free Software Foundation, either version 3 of the License,     *
+ *   or (at your option) any later version.                                *
+ *                                                                         *
+ *   apple1emu is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty           *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.               *
+ *   See the GNU General Public License for more details.                  *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef BUS_H
+#define BUS_H
+
+#include "mem.h"
+#include "clock.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define BUS_PAGES 0x100
+// Chips that can share a page, when some of them don't cover all of it
+#define BUS_PAGE_DEVICES 4
+
+// Only clocked for accesses between start and end
+typedef struct {
+  Connected_chip* chip;
+  uint16_t start;
+  uint16_t end;
+} Bus_device;
+
+// What answers on every page of the address space. Pages fully within some
+// memory are accessed straight through mem, anything else goes to the
+// devices on it that cover the address
+typedef struct {
+  uint8_t* mem;
+  // For the dirty pages and the write listener
+  Mem_16* owner;
+  bool writable;
+  unsigned int num_devices;
+  Bus_device devices[BUS_PAGE_DEVICES];
+} Bus_page;
+
+typedef struct {
+  Bus_page pages[BUS_PAGES];
+  volatile uint16_t* addr_bus;
+  volatile uint8_t* data_bus;
+  bool* RW;
+} Bus;
+
+void init_bus(Bus* b, volatile uint16_t* addr_bus, volatile uint8_t* data_bus, bool* RW);
+// Memory in its whole range, chip being its clock_mem callback for the pages
+// it only covers partially or shares with something mapped before
+int bus_map_mem(Bus* b, Mem_16* m, bool writable, Connected_chip* chip);
+int bus_map_device(Bus* b, uint16_t start, uint16_t end, Connected_chip* chip);
+// Goes on the clock instead of all the chips mapped to it
+void clock_bus(void* ptr, bool status);
+
+#endif
@@ -18,20 +18,34 @@
  *                                                                         *
  ***************************************************************************/
 
+// For pthread_setaffinity_np
+#define _GNU_SOURCE
+
 #include "clock.h"
 #include "errors.h"
 
 #include <string.h>
 #include <pthread.h>
+#include <sched.h>
+#include <math.h>
 #include <stdio.h>
 #include <time.h>
 #include <sys/time.h>
+#include <errno.h>
 
 void init_clock(Clock* c, unsigned int freq) {
   c->enabled = true;
   c->active = false;
   c->freq = freq;
   c->num_chips = 0;
+  c->cycle_count = NULL;
+  c->runner = NULL;
+  c->quantum = DEFAULT_CLOCK_QUANTUM;
+  c->realtime_core = NO_CORE;
+  c->realtime_fifo = false;
+  c->spin_ns = 0;
+  memset(&c->jitter, 0, sizeof(Clock_jitter));
+  pthread_mutex_init(&c->jitter_lock, NULL);
   memset(c->clock_bus, 0, MAX_CHIPS_ON_BUS * sizeof(Connected_chip*));
   c->turbo = false;
 }
@@ -44,30 +58,160 @@ int clock_connect(Clock* c, Connected_chip* chip) {
   return SUCCESS;
 }
 
+// When the cycle count gets to count, counting from a base time and count
+static struct timespec emulated_deadline(Clock* c, struct timespec* base_time, unsigned long long cycles) {
+  // Whole seconds first, so that it doesn't overflow no matter how long it
+  // has been running
+  unsigned long long ns = (cycles % c->freq) * 1000000000ULL / c->freq;
+  struct timespec deadline = {
+    .tv_sec = base_time->tv_sec + cycles / c->freq,
+    .tv_nsec = base_time->tv_nsec + ns,
+  };
+  if(deadline.tv_nsec >= 1000000000) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000;
+  }
+  return deadline;
+}
+
+static long long ns_between(struct timespec* from, struct timespec* to) {
+  return (to->tv_sec - from->tv_sec) * 1000000000LL + (to->tv_nsec - from->tv_nsec);
+}
+
+// Not being allowed to doesn't stop the clock, it just won't be as steady
+static void set_realtime(Clock* c) {
+  if(c->realtime_core != NO_CORE) {
+    cpu_set_t cores;
+    CPU_ZERO(&cores);
+    CPU_SET(c->realtime_core, &cores);
+    int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cores);
+    if(ret) {
+      fprintf(stderr, "Unable to pin the clock thread to core %d: %s\n", c->realtime_core, strerror(ret));
+    }
+  }
+  if(c->realtime_fifo) {
+    struct sched_param param = {
+      .sched_priority = sched_get_priority_min(SCHED_FIFO),
+    };
+    int ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if(ret) {
+      fprintf(stderr, "Unable to use SCHED_FIFO for the clock thread: %s\n", strerror(ret));
+    }
+  }
+}
+
+// Sleeps until spin_ns before the deadline, then spins the rest of the way, so
+// that waking up late is down to the spin and not the scheduler
+static void wait_until(Clock* c, struct timespec* deadline) {
+  struct timespec wake = *deadline;
+  struct timespec now;
+  wake.tv_sec -= c->spin_ns / 1000000000;
+  wake.tv_nsec -= c->spin_ns % 1000000000;
+  if(wake.tv_nsec < 0) {
+    wake.tv_sec--;
+    wake.tv_nsec += 1000000000;
+  }
+  while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL) == EINTR) {
+    // Same deadline, whatever woke us up
+  }
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  struct timespec spin_start = now;
+  while(ns_between(deadline, &now) < 0) {
+    clock_gettime(CLOCK_MONOTONIC, &now);
+  }
+
+  long long late = ns_between(deadline, &now);
+  Clock_jitter* j = &c->jitter;
+  pthread_mutex_lock(&c->jitter_lock);
+  if(!j->samples) {
+    j->since = now;
+  }
+  j->samples++;
+  j->sum += late;
+  j->sum_sq += (double)late * late;
+  if(late > j->max) {
+    j->max = late;
+  }
+  j->spin_ns += ns_between(&spin_start, &now);
+  pthread_mutex_unlock(&c->jitter_lock);
+}
+
+void get_clock_jitter(Clock* c, Clock_jitter* jitter) {
+  pthread_mutex_lock(&c->jitter_lock);
+  *jitter = c->jitter;
+  pthread_mutex_unlock(&c->jitter_lock);
+}
+
+void print_clock_jitter(Clock* c) {
+  Clock_jitter jitter;
+  get_clock_jitter(c, &jitter);
+  Clock_jitter* j = &jitter;
+  if(!j->samples) {
+    fprintf(stderr, "No paced quanta yet\n");
+    return;
+  }
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  double mean = j->sum / j->samples;
+  double variance = j->sum_sq / j->samples - mean * mean;
+  long long elapsed = ns_between(&j->since, &now);
+  fprintf(stderr, "Quantum jitter over %llu quanta: mean %.1fus, stddev %.1fus, max %.1fus, spinning %.1f%% of the time\n",
+    j->samples, mean / 1000, sqrt(variance > 0 ? variance : 0) / 1000, j->max / 1000.0,
+    elapsed > 0 ? 100.0 * j->spin_ns / elapsed : 0);
+}
+
 void *clock_run(void* ptr) {
   Clock* c = (Clock*)ptr;
-  unsigned short tick_count = 0;
-  struct timespec begin={0,0};
-  struct timespec end={0,0};
-  struct timespec delta={0,0};
-  clock_gettime(CLOCK_MONOTONIC, &begin);
+  unsigned long long tick_count = 0;
+  unsigned long long paced_count = 0;
+  // Emulated time is kept as the cycles since the base, which happened at
+  // base_time. Deadlines are all worked out from there, so rounding errors
+  // and oversleeping don't pile up
+  unsigned long long base_count = 0;
+  struct timespec base_time;
+  struct timespec now;
+  bool rebase = true;
+  set_realtime(c);
   while(!(*c->stop)) {
-    if(c->enabled) {
-      c->active = true;
+    if(!c->enabled) {
+      // Whatever paused us, the time spent paused doesn't count
+      rebase = true;
+      continue;
+    }
+    c->active = true;
+    unsigned long long ran = 1;
+    if(c->runner != NULL) {
+      ran = (*c->runner->callback)(c->runner->chip, c->quantum);
+    } else {
       tick(c);
       tock(c);
-      c->active = false;
-      if(c->turbo) {
-        continue;
-      }
-      if((++tick_count == TICKS_FOR_SYNC)) {
-        clock_gettime(CLOCK_MONOTONIC, &end);
-        delta.tv_nsec = (1e9/c->freq)*TICKS_FOR_SYNC - (end.tv_nsec - begin.tv_nsec) - c->clock_adjust;
-        nanosleep(&delta, NULL);
-        clock_gettime(CLOCK_MONOTONIC, &begin);
-        tick_count = 0;
-      }
     }
+    c->active = false;
+    tick_count = c->cycle_count != NULL ? *c->cycle_count : tick_count + ran;
+    if(c->turbo || rebase || tick_count < base_count) {
+      // Turbo, or the count went back (loaded state), just start over
+      clock_gettime(CLOCK_MONOTONIC, &base_time);
+      base_count = tick_count;
+      paced_count = tick_count;
+      rebase = false;
+      continue;
+    }
+    if(tick_count - paced_count < c->quantum) {
+      continue;
+    }
+    paced_count = tick_count;
+    struct timespec deadline = emulated_deadline(c, &base_time, tick_count - base_count);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if(ns_between(&deadline, &now) > CLOCK_MAX_LAG) {
+      // The host couldn't keep up (or was busy with something else), there's
+      // no point in trying to make up for it
+      rebase = true;
+      continue;
+    }
+    wait_until(c, &deadline);
+  }
+  if(c->realtime_core != NO_CORE || c->realtime_fifo || c->spin_ns) {
+    print_clock_jitter(c);
   }
   fprintf(stderr, "Stopping clock thread...\n");
   pthread_exit(0);
@@ -23,10 +23,20 @@
 
 #include <stdbool.h>
 #include <pthread.h>
+#include <time.h>
 
 #define MAX_CHIPS_ON_BUS 0xFF
-#define TICKS_FOR_SYNC 1000
-#define CLOCK_ADJUST_GRANULARITY 1e5
+// Cycles run between checks against the emulated time, by default
+#define DEFAULT_CLOCK_QUANTUM 1000
+// Falling behind by more than this (in ns) starts the pacing over from where
+// we are, instead of running flat out to catch up
+#define CLOCK_MAX_LAG 100000000
+// How long before every deadline realtime mode stops sleeping and starts
+// spinning, by default (in ns)
+#define DEFAULT_REALTIME_SPIN 100000
+// Upper bound for -W (in us), past a second it's just a busy loop
+#define MAX_SPIN_US 1000000
+#define NO_CORE -1
 
 typedef void (*clock_callback)(void*, bool);
 typedef struct {
@@ -34,12 +44,50 @@ typedef struct {
   void* chip;
 } Connected_chip;
 
+// For a chip that can run a whole batch of cycles on its own, driving the rest
+// of the chips. Returns the cycles actually run
+typedef unsigned long long (*batch_callback)(void*, unsigned long long);
+typedef struct {
+  batch_callback callback;
+  void* chip;
+} Batch_runner;
+
+// How late every quantum got to its deadline, in ns
+typedef struct {
+  unsigned long long samples;
+  double sum;
+  double sum_sq;
+  long long max;
+  // Time spent spinning, and since the first sample, to tell what the
+  // smoothness costs
+  unsigned long long spin_ns;
+  struct timespec since;
+} Clock_jitter;
+
 typedef struct {
   unsigned int freq;
   Connected_chip* clock_bus[MAX_CHIPS_ON_BUS];
   unsigned int num_chips;
   volatile bool* stop;
-  long int clock_adjust;
+  // Chips that can run more than one cycle per tick (i.e. the CPU when
+  // stepping whole instructions) report them here, so we pace on this instead
+  // of on the number of ticks if set
+  unsigned long long* cycle_count;
+  // If set, clock_run hands it quantum cycles at a time instead of
+  // ticking the bus itself, so control requests are only polled in between
+  Batch_runner* runner;
+  // Cycles between sleeps until the emulated time catches up with the real
+  // one. Every deadline is absolute, so it doesn't change the overall speed
+  unsigned int quantum;
+  // Realtime mode: clock_run pins itself to this core (unless NO_CORE),
+  // optionally with SCHED_FIFO, and sleeps until spin_ns before every
+  // deadline, spinning the rest of the way
+  int realtime_core;
+  bool realtime_fifo;
+  unsigned long long spin_ns;
+  // Updated by clock_run, read from other threads under jitter_lock
+  Clock_jitter jitter;
+  pthread_mutex_t jitter_lock;
   volatile bool turbo;
   volatile bool enabled;
   volatile bool active;
@@ -48,6 +96,9 @@ typedef struct {
 void init_clock(Clock* c, unsigned int freq);
 int clock_connect(Clock* c, Connected_chip* callback);
 void *clock_run(void* ptr);
+// A consistent copy of the jitter stats, from any thread
+void get_clock_jitter(Clock* c, Clock_jitter* jitter);
+void print_clock_jitter(Clock* c);
 void tick(Clock* c);
 void tock(Clock* c);
 
@@ -0,0 +1,142 @@
+/***************************************************************************
+ *   display.c  --  This file is part of apple1emu.                        *
+ *                                                                         *
+ *   Copyright (C) 2021 Imanol-Mikel Barba Sabariego                       *
+ *                                                                         *
+ *   apple1emu is free software: you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published     *
+ *   by the Free Software Foundation, either version 3 of the License,     *
+ *   or (at your option) any later version.                                *
+ *                                                                         *
+ *   apple1emu is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty           *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.               *
+ *   See the GNU General Public License for more details.                  *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "display.h"
+#include "errors.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+void init_display(Display* d, int fd) {
+  d->fd = fd;
+  d->head = 0;
+  d->tail = 0;
+  d->running = false;
+  d->stop = false;
+  pthread_mutex_init(&d->lock, NULL);
+  pthread_cond_init(&d->wake, NULL);
+}
+
+void destroy_display(Display* d) {
+  pthread_mutex_destroy(&d->lock);
+  pthread_cond_destroy(&d->wake);
+}
+
+bool display_put(Display* d, const char* data, size_t length) {
+  size_t tail = __atomic_load_n(&d->tail, __ATOMIC_ACQUIRE);
+  if(DISPLAY_BUFFER_SIZE - (d->head - tail) < length) {
+    if(d->running) {
+      return false;
+    }
+    flush_display(d);
+  }
+  for(size_t i = 0; i < length; ++i) {
+    d->buffer[(d->head + i) % DISPLAY_BUFFER_SIZE] = data[i];
+  }
+  __atomic_store_n(&d->head, d->head + length, __ATOMIC_RELEASE);
+  return true;
+}
+
+void kick_display(Display* d) {
+  if(d->running && __atomic_load_n(&d->tail, __ATOMIC_RELAXED) != d->head) {
+    pthread_mutex_lock(&d->lock);
+    pthread_cond_signal(&d->wake);
+    pthread_mutex_unlock(&d->lock);
+  }
+}
+
+// Everything up to head, as few writes as the wrap around allows
+static void write_pending(Display* d) {
+  size_t head = __atomic_load_n(&d->head, __ATOMIC_ACQUIRE);
+  size_t tail = d->tail;
+  while(tail != head) {
+    size_t start = tail % DISPLAY_BUFFER_SIZE;
+    size_t length = head - tail;
+    if(length > DISPLAY_BUFFER_SIZE - start) {
+      length = DISPLAY_BUFFER_SIZE - start;
+    }
+    ssize_t written = write(d->fd, d->buffer + start, length);
+    if(written == -1) {
+      if(errno == EINTR) {
+        continue;
+      }
+      fprintf(stderr, "Error printing to display\n");
+      // Drop it, rather than getting stuck on it
+      tail = head;
+    } else {
+      tail += written;
+    }
+    __atomic_store_n(&d->tail, tail, __ATOMIC_RELEASE);
+  }
+}
+
+static void* display_run(void* ptr) {
+  Display* d = (Display*)ptr;
+  pthread_mutex_lock(&d->lock);
+  while(true) {
+    while(!d->stop && __atomic_load_n(&d->head, __ATOMIC_ACQUIRE) == d->tail) {
+      pthread_cond_wait(&d->wake, &d->lock);
+    }
+    if(__atomic_load_n(&d->head, __ATOMIC_ACQUIRE) == d->tail) {
+      // Stopping, and nothing left
+      break;
+    }
+    pthread_mutex_unlock(&d->lock);
+    write_pending(d);
+    pthread_mutex_lock(&d->lock);
+  }
+  pthread_mutex_unlock(&d->lock);
+  return NULL;
+}
+
+int start_display(Display* d) {
+  d->stop = false;
+  if(pthread_create(&d->writer, NULL, display_run, d)) {
+    fprintf(stderr, "Error creating thread\n");
+    return ERROR_PTHREAD_CREATE;
+  }
+  d->running = true;
+  return SUCCESS;
+}
+
+void stop_display(Display* d) {
+  if(!d->running) {
+    return;
+  }
+  pthread_mutex_lock(&d->lock);
+  d->stop = true;
+  pthread_cond_signal(&d->wake);
+  pthread_mutex_unlock(&d->lock);
+  if(pthread_join(d->writer, NULL)) {
+    fprintf(stderr, "Error joining display thread\n");
+  }
+  d->running = false;
+}
+
+void flush_display(Display* d) {
+  if(d->running) {
+    // Not ours to drain
+    kick_display(d);
+    return;
+  }
+  write_pending(d);
+}
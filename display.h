@@ -0,0 +1,60 @@
+/***************************************************************************
+ *   display.h  --  This file is part of apple1emu.                        *
+ *                                                                         *
+ *   Copyright (C) 2021 Imanol-Mikel Barba Sabariego                       *
+ *                                                                         *
+ *   apple1emu is free software: you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published     *
+ *   by the Free Software Foundation, either version 3 of the License,     *
+ *   or (at your option) any later version.                                *
+ *                                                                         *
+ *   apple1emu is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty           *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.               *
+ *   See the GNU General Public License for more details.                  *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#define DISPLAY_BUFFER_SIZE 4096
+
+// Whatever the PIA prints, buffered so that it takes one write per batch
+// instead of one per char. The writer thread drains it while the machine
+// runs, otherwise it's up to flush_display
+typedef struct Display {
+  int fd;
+  char buffer[DISPLAY_BUFFER_SIZE];
+  // Only ever growing, wrapped around the buffer. Head is only moved by the
+  // CPU thread, tail only by whoever drains it
+  size_t head;
+  size_t tail;
+  pthread_t writer;
+  bool running;
+  volatile bool stop;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+} Display;
+
+void init_display(Display* d, int fd);
+void destroy_display(Display* d);
+// All or nothing, false if there's no room for it with the writer running.
+// Without it, it flushes to make room
+bool display_put(Display* d, const char* data, size_t length);
+// Lets the writer know there's something for it
+void kick_display(Display* d);
+int start_display(Display* d);
+// Drains it before returning
+void stop_display(Display* d);
+// Writes out everything pending, or wakes the writer up if it's running
+void flush_display(Display* d);
+
+#endif
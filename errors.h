@@ -35,7 +35,8 @@ enum error {
   ERROR_INVALID_MEMORY_RANGE = -10,
   ERROR_PTHREAD_CREATE = -11,
   ERROR_PTHREAD_JOIN = -12,
-  ERROR_PTHREAD_SIGNAL = -13
+  ERROR_PTHREAD_SIGNAL = -13,
+  ERROR_TOO_MANY_CHIPS_ON_PAGE = -14
 };
 
 #endif
@@ -20,12 +20,12 @@
 
 #include "m6502.h"
 #include "m6502_opcodes.h"
+#include "m6502_instr.h"
+#include "m6502_jit.h"
+#include "m6502_profile.h"
 #include "errors.h"
 
 #include <stdio.h>
-#include <unistd.h>
-#include <fcntl.h>
-#include <errno.h>
 
 extern Opcode* opcodes[0x10000];
 
@@ -44,8 +44,8 @@ void get_arg_indirect_index(M6502* cpu) {
     break;
     case 3:
       cpu->AD |= *cpu->data_bus << 8; // full addr
-      *cpu->addr_bus = (cpu->AD & 0xFF00) | (cpu->AD + cpu->Y);
-      if(((cpu->AD + cpu->Y) <= 0xFF) && !opcodes[(cpu->IR >> 3)]->write) {
+      *cpu->addr_bus = (cpu->AD & 0xFF00) | ((cpu->AD + cpu->Y) & 0x00FF);
+      if((((cpu->AD & 0x00FF) + cpu->Y) <= 0xFF) && !opcodes[(cpu->IR >> 3)]->write) {
         // if we're on the same page already, 1 less cycle
         cpu->IR++;
       }
@@ -359,6 +359,8 @@ uint8_t do_ROR(M6502* cpu, uint8_t x) {
 
 void cpu_crash(M6502* cpu) {
   *cpu->stop = true;
+  cpu->exit_requested = true;
+  cpu->crashed = true;
   fprintf(stderr, "!! CPU CRASH !!\n");
   fprintf(stderr, "== REGISTERS ==\n");
   fprintf(stderr, "PC=0x%04X\n", cpu->PC);
@@ -379,154 +381,58 @@ void cpu_crash(M6502* cpu) {
   fprintf(stderr, "== EXTERNAL INTERFACE ==\n");
   fprintf(stderr, "addr_bus=0x%04X\n", *cpu->addr_bus);
   fprintf(stderr, "data=0x%02X\n", *cpu->data_bus);
-  fprintf(stderr, "IRQ=%s\n", *cpu->IRQ ? "HI" : "LO");
-  fprintf(stderr, "NMI=%s\n", *cpu->NMI ? "HI" : "LO");
-  fprintf(stderr, "RES=%s\n", *cpu->RES ? "HI" : "LO");
-  fprintf(stderr, "RDY=%s\n", *cpu->RDY ? "HI" : "LO");
+  fprintf(stderr, "IRQ=%s\n", (cpu->lines & LINE_IRQ) ? "LO" : "HI");
+  fprintf(stderr, "NMI=%s\n", (cpu->lines & LINE_NMI_LEVEL) ? "LO" : "HI");
+  fprintf(stderr, "RES=%s\n", (cpu->lines & LINE_RES) ? "LO" : "HI");
+  fprintf(stderr, "RDY=%s\n", (cpu->lines & LINE_RDY) ? "LO" : "HI");
   fprintf(stderr, "RW=%s\n", cpu->RW ? "HI" : "LO");
-  fprintf(stderr, "SO=%s\n", *cpu->SO ? "HI" : "LO");
+  fprintf(stderr, "SO=%s\n", (cpu->lines & LINE_SO) ? "LO" : "HI");
   fprintf(stderr, "SYNC=%s\n", cpu->SYNC ? "HI" : "LO");
   fprintf(stderr, "\n");
-
-  save_state(cpu);
-}
-
-int dump_file(const char* path, uint8_t* data, size_t data_size) {
-  int fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0644);
-  if(fd == -1) {
-    fprintf(stderr, "Error opening data dump\n");
-    return ERROR_OPEN_FILE;
-  }
-  ssize_t written;
-  size_t total = 0;
-  while(total != data_size) {
-    written = write(fd, data + total, data_size - total);
-    if(written < 0) {
-      if(errno == EINTR) {
-        continue;
-      }
-      fprintf(stderr, "Error writing data\n");
-      close(fd);
-      return ERROR_WRITE_FILE;
-    }
-    total += written;
-  }
-  close(fd);
-  return SUCCESS;
-}
-
-int load_dump(const char* path, uint8_t* data, size_t data_size) {
-  int fd = open(path, O_RDONLY);
-  if(fd == -1) {
-    fprintf(stderr, "Error opening data dump\n");
-    return ERROR_OPEN_FILE;
-  }
-  ssize_t bytes_read;
-  size_t total = 0;
-  while(total != data_size) {
-    bytes_read = read(fd, data + total, data_size - total);
-    if(bytes_read < 0) {
-      if(errno == EINTR) {
-        continue;
-      }
-      fprintf(stderr, "Error reading data\n");
-      close(fd);
-      return ERROR_READ_FILE;
-    }
-    total += bytes_read;
-  }
-  close(fd);
-  return SUCCESS;
 }
 
-int save_state(M6502* cpu) {
-  cpu->enabled = false;
-  while(cpu->active) {
-    // spin
-  }
-  // Dump registers, external pins and buses
-  M6502_State state;
-  state.A = cpu->A;
-  state.X = cpu->X;
-  state.Y = cpu->Y;
-  state.S = cpu->S;
-  state.status = cpu->status;
-  state.PC = cpu->PC;
-  state.data_bus = *cpu->data_bus;
-  state.addr_bus = *cpu->addr_bus;
-  state.RW = cpu->RW ? 1 : 0;
-  state.SYNC = cpu->SYNC ? 1 : 0;
-  state.tick_count = cpu->tick_count;
-  state.IR = cpu->IR;
-  state.break_status = cpu->break_status;
-  state.AD = cpu->AD;
-
-  // Just in case, we'll restore later
-  cpu->RW = true;
-
-  for(unsigned int i = 0; i < MEMSIZE; ++i) {
-    *cpu->addr_bus = i;
-    clock_cpu((void*)cpu, true);
-    state.mem[i] = *cpu->data_bus;
-  }
-
-  // Restore bus and RW
-  *cpu->addr_bus = state.addr_bus;
-  *cpu->data_bus = state.data_bus;
-  cpu->RW = state.RW ? true : false;
-
-  if(dump_file("savestate", (uint8_t*)&state, sizeof(state)) != SUCCESS) {
-    cpu->enabled = true;
-    return FAILURE;
-  }
-  fprintf(stderr, "State dumped to \"savestate\"\n");
-  cpu->enabled = true;
-  return SUCCESS;
+void get_cpu_state(M6502* cpu, M6502_State* state) {
+  state->tick_count = cpu->tick_count;
+  state->instructions = cpu->instructions;
+  state->A = cpu->A;
+  state->X = cpu->X;
+  state->Y = cpu->Y;
+  state->PC = cpu->PC;
+  state->S = cpu->S;
+  state->status = cpu->status;
+  state->RW = cpu->RW ? 1 : 0;
+  state->SYNC = cpu->SYNC ? 1 : 0;
+  state->IR = cpu->IR;
+  state->break_status = cpu->break_status;
+  state->AD = cpu->AD;
+  state->addr_bus = *cpu->addr_bus;
+  state->data_bus = *cpu->data_bus;
+  state->lines = cpu->lines;
+  state->cycle_lines = cpu->cycle_lines;
+  state->mode = cpu->mode;
 }
 
-int load_state(M6502* cpu) {
-  // Load the stuff back. We have to guarantee that if something fails, the
-  // current state won't change
-
-  cpu->enabled = false;
-
-  M6502_State state;
-
-  if(load_dump("savestate", (uint8_t*)&state, sizeof(state)) != SUCCESS) {
-    cpu->enabled = true;
-    return FAILURE;
-  }
-
-  while(cpu->active) {
-    // spin
-  }
-
-  cpu->RW = false;
-  for(unsigned int i = 0; i < MEMSIZE; ++i) {
-    *cpu->addr_bus = i;
-    *cpu->data_bus = state.mem[i];
-    clock_cpu((void*)cpu, true);
-  }
-  fprintf(stderr, "Loaded memory\n");
-
-  cpu->A = state.A;
-  cpu->X = state.X;
-  cpu->Y = state.Y;
-  cpu->S = state.S;
-  cpu->status = state.status;
-  cpu->PC = state.PC;
-  *cpu->data_bus = state.data_bus;
-  *cpu->addr_bus = state.addr_bus;
-  cpu->RW = state.RW ? true : false;
-  cpu->SYNC = state.SYNC ? true : false;
-  cpu->tick_count = state.tick_count;
-  cpu->IR = state.IR;
-  cpu->break_status = state.break_status;
-  cpu->AD = state.AD;
-  fprintf(stderr, "Loaded registers\n");
-
-  cpu->enabled = true;
-  return SUCCESS;
+void set_cpu_state(M6502* cpu, const M6502_State* state) {
+  cpu->tick_count = state->tick_count;
+  cpu->instructions = state->instructions;
+  cpu->A = state->A;
+  cpu->X = state->X;
+  cpu->Y = state->Y;
+  cpu->PC = state->PC;
+  cpu->S = state->S;
+  cpu->status = state->status;
+  cpu->RW = state->RW ? true : false;
+  cpu->SYNC = state->SYNC ? true : false;
+  cpu->IR = state->IR;
+  cpu->break_status = state->break_status;
+  cpu->AD = state->AD;
+  *cpu->addr_bus = state->addr_bus;
+  *cpu->data_bus = state->data_bus;
+  cpu->lines = state->lines;
+  cpu->cycle_lines = state->cycle_lines;
+  // Mid-instruction states can only go on in the engine they were saved in,
+  // the requested one takes over again on the next instruction boundary
+  cpu->mode = state->mode;
 }
 
 void clock_cpu(void* ptr, bool status) {
@@ -541,8 +447,13 @@ void clock_cpu(void* ptr, bool status) {
   }
 }
 
+unsigned long long clock_cpu_batch(void* ptr, unsigned long long cycles) {
+  return cpu_run_cycles((M6502*)ptr, cycles);
+}
+
 void init_cpu(M6502* cpu) {
   cpu->tick_count = 0;
+  cpu->crashed = false;
 
   cpu->A = 0;
   cpu->X = 0;
@@ -557,42 +468,106 @@ void init_cpu(M6502* cpu) {
   cpu->PCH = (((uint8_t*)&cpu->PC)+1);
   cpu->PCL = ((uint8_t*)&cpu->PC);
 
-  *cpu->RES = false;
+  // Power on reset. The rest of the lines are up to the devices
+  cpu_set_line(cpu, LINE_RES, true);
+  cpu->cycle_lines = 0;
   cpu->RW = true;
   cpu->SYNC = true;
   cpu->enabled = true;
-}
+  // requested_mode is left alone, so that it can be chosen before booting
+  cpu->mode = CPU_MODE_CYCLE;
 
-void cpu_cycle(M6502* cpu) {
-  if(*cpu->stop || !cpu->enabled) {
-    // CPU is disabled or stopped
-    return;
+  // Same for the cacheable pages, which are set up when connecting the memory.
+  // If we can't get the cache, the instruction-level engine just decodes
+  // every time
+  free(cpu->decode_cache);
+  cpu->decode_cache = calloc(MEMSIZE, sizeof(Decoded_instr));
+  if(cpu->decode_cache == NULL) {
+    fprintf(stderr, "Unable to alloc decode cache, running without it\n");
   }
-  cpu->active = true;
-  cpu->tick_count++;
+}
 
-  if(!*cpu->RES) {
-    cpu->break_status |= BRK_RST;
+void destroy_cpu(M6502* cpu) {
+  free(cpu->decode_cache);
+  cpu->decode_cache = NULL;
+  destroy_jit(cpu);
+  destroy_profile(cpu);
+  destroy_call_profile(cpu);
+}
+
+void cpu_set_line(M6502* cpu, uint8_t line, bool asserted) {
+  // Devices might be running on other threads
+  if(line == LINE_NMI) {
+    if(asserted) {
+      if(!(__atomic_fetch_or(&cpu->lines, LINE_NMI_LEVEL, __ATOMIC_SEQ_CST) & LINE_NMI_LEVEL)) {
+        // Falling edge
+        __atomic_fetch_or(&cpu->lines, LINE_NMI, __ATOMIC_SEQ_CST);
+      }
+    } else {
+      __atomic_fetch_and(&cpu->lines, (uint8_t)~LINE_NMI_LEVEL, __ATOMIC_SEQ_CST);
+    }
+  } else if(asserted) {
+    __atomic_fetch_or(&cpu->lines, line, __ATOMIC_SEQ_CST);
+  } else {
+    __atomic_fetch_and(&cpu->lines, (uint8_t)~line, __ATOMIC_SEQ_CST);
   }
-  if(!*cpu->NMI) {
-    cpu->break_status |= BRK_NMI;
+}
+
+// Picks up the lines asserted since the last instruction boundary
+static inline void latch_lines(M6502* cpu) {
+  uint8_t lines = cpu->lines;
+  // NMI edges and resets are taken once, IRQ stays as long as it's held and
+  // interrupts are enabled
+  uint8_t taken = lines & (LINE_NMI | LINE_RES);
+  if(taken) {
+    __atomic_fetch_and(&cpu->lines, (uint8_t)~taken, __ATOMIC_SEQ_CST);
   }
-  if(!*cpu->IRQ) {
-    cpu->break_status |= BRK_IRQ;
+  if((lines & LINE_IRQ) && !(cpu->status & STATUS_IF)) {
+    taken |= BRK_IRQ;
   }
+  cpu->break_status |= taken;
+  cpu->cycle_lines = lines & LINE_CYCLE_MASK;
+}
 
-  if(!*cpu->RDY && cpu->RW) {
-    // RDY is only checked during READ cycle on the original 6502
-    return;
+// A single cycle, without looking at the stop and enable controls
+static inline void cpu_step(M6502* cpu) {
+  cpu->tick_count++;
+
+  if(cpu->SYNC && cpu->lines) {
+    latch_lines(cpu);
   }
 
-  if(!*cpu->SO) {
-    cpu->status |= STATUS_VF;
+  if(cpu->cycle_lines) {
+    // Keep following RDY and SO for as long as they're asserted
+    cpu->cycle_lines = cpu->lines & LINE_CYCLE_MASK;
+    if((cpu->cycle_lines & LINE_RDY) && cpu->RW) {
+      // RDY is only checked during READ cycle on the original 6502
+      return;
+    }
+    if(cpu->cycle_lines & LINE_SO) {
+      cpu->status |= STATUS_VF;
+    }
   }
 
   // TODO mem rw breakpoint
 
   if(cpu->SYNC) {
+    cpu->instructions++;
+    if(cpu->profile != NULL) {
+      // This instruction started on the cycle we just counted
+      profile_instruction(cpu->profile, cpu->PC, cpu->break_status ? 0x00 : *cpu->data_bus, cpu->tick_count - 1);
+    }
+    if(cpu->call_profile != NULL) {
+      profile_call_cycles(cpu->call_profile, cpu->tick_count - 1);
+    }
+    // Only switch engines between instructions, both leave the CPU in the same
+    // state at this point
+    cpu->mode = cpu->requested_mode;
+    if(cpu->mode == CPU_MODE_INSTRUCTION) {
+      // The first cycle has already been accounted for
+      cpu->tick_count += run_instruction(cpu) - 1;
+      return;
+    }
     if(cpu->break_status) {
       cpu->IR = 0x00; // BRK
     } else {
@@ -606,5 +581,41 @@ void cpu_cycle(M6502* cpu) {
   cpu->RW = true;
   run_opcode(cpu);
   cpu->IR++;
+}
+
+void cpu_cycle(M6502* cpu) {
+  if(*cpu->stop || !cpu->enabled) {
+    // CPU is disabled or stopped
+    return;
+  }
+  cpu->active = true;
+  cpu_step(cpu);
+  cpu->active = false;
+}
+
+unsigned long long cpu_run_cycles(M6502* cpu, unsigned long long cycles) {
+  // Same checks as cpu_cycle, but only once for the whole batch
+  if(*cpu->stop || !cpu->enabled) {
+    return 0;
+  }
+  cpu->active = true;
+  unsigned long long start = cpu->tick_count;
+  unsigned long long end = start + cycles;
+  cpu->run_until = end;
+  while(cpu->tick_count < end && !cpu->exit_requested) {
+    if(cpu->SYNC && cpu->break_enabled && cpu->PC == cpu->break_addr && cpu->tick_count != start) {
+      // Unless we're just resuming from it
+      break;
+    }
+    // Same as clock_cpu on both edges of the main clock
+    tock(&cpu->phi1);
+    cpu_step(cpu);
+    tick(&cpu->phi2);
+    tock(&cpu->phi2);
+    tick(&cpu->phi1);
+  }
+  cpu->run_until = 0;
+  cpu->exit_requested = false;
   cpu->active = false;
+  return cpu->tick_count - start;
 }
@@ -35,6 +35,18 @@
 #define BRK_NMI 0x02
 #define BRK_RST 0x04
 
+// Input lines, as bits of M6502.lines, set while the line is asserted (pulled
+// low). The interrupt ones match the BRK_ bits they end up triggering
+#define LINE_IRQ BRK_IRQ
+#define LINE_NMI BRK_NMI
+#define LINE_RES BRK_RST
+#define LINE_RDY 0x08
+#define LINE_SO 0x10
+// NMI is edge triggered, LINE_NMI is the pending edge and this the level
+#define LINE_NMI_LEVEL 0x20
+// Lines that have to be looked at on every cycle while asserted
+#define LINE_CYCLE_MASK (LINE_RDY | LINE_SO)
+
 #define STATUS_CF 0x01 // CARRY
 #define STATUS_ZF 0x02 // ZERO
 #define STATUS_IF 0x04 // IRQ DISABLE
@@ -44,13 +56,52 @@
 #define STATUS_VF 0x40 // OVERFLOW
 #define STATUS_NF 0x80 // NEGATIVE
 
+enum cpu_mode {
+  CPU_MODE_CYCLE = 0,
+  CPU_MODE_INSTRUCTION = 1
+};
+
 #define NMI_VECTOR_ADDR   0xFFFA
 #define RESET_VECTOR_ADDR 0xFFFC
 #define IRQ_VECTOR_ADDR   0xFFFE
 
+#define PAGE_SIZE 0x100
+#define NUM_PAGES (MEMSIZE / PAGE_SIZE)
+
+struct M6502;
+typedef uint8_t (*instr_func)(struct M6502*, uint16_t);
+
+// Pairs of instructions the instruction-level engine runs as one
+enum fusion {
+  FUSION_NONE = 0,
+  FUSION_CMP_BNE = 1, // CMP #imm / BNE
+  FUSION_LDA_STA = 2, // LDA zp / STA zp
+  FUSION_INX_BNE = 3, // INX / BNE
+  FUSION_DEY_BPL = 4, // DEY / BPL
+  NUM_FUSIONS = 5
+};
+
+// Instruction decoded by the instruction-level engine, cached by address
 typedef struct {
+  instr_func instr;
+  uint16_t operand;
+  uint8_t opcode;
+  uint8_t addr_mode;
+  uint8_t cycles;
+  bool write;
+  // 0 if there's nothing decoded at this address
+  uint8_t length;
+  // If this and the next instruction can run together: which pair it is, the
+  // operand of the second one and the length of both
+  uint8_t fusion;
+  uint16_t fused_operand;
+  uint8_t fused_length;
+} Decoded_instr;
+
+typedef struct M6502 {
   // Just profiling
   unsigned long long int tick_count;
+  unsigned long long int instructions;
 
   // To signal that the CPU has stopped
   volatile bool* stop;
@@ -61,6 +112,40 @@ typedef struct {
   // True when the CPU is actively processing a cycle
   volatile bool active;
 
+  // Makes cpu_run_cycles return at the next cycle, cleared once it does
+  bool exit_requested;
+  // Cycle cpu_run_cycles is running until, so that translated blocks don't
+  // run past it. 0 outside of it, for just an instruction at a time
+  unsigned long long run_until;
+  // Set by cpu_crash, for whoever wants to dump the state afterwards
+  bool crashed;
+
+  // Makes cpu_run_cycles return before executing the instruction at this
+  // address
+  bool break_enabled;
+  uint16_t break_addr;
+
+  // Execution engine currently running, either stepping every cycle or whole
+  // instructions at once. Changes to requested_mode only take effect on the
+  // next instruction boundary
+  int mode;
+  volatile int requested_mode;
+
+  // Decoded instructions by address for the instruction-level engine, only for
+  // the pages marked as cacheable, whose memory reports writes so that the
+  // entries can be invalidated
+  Decoded_instr* decode_cache;
+  bool cacheable[NUM_PAGES];
+  // Times every pair of instructions ran fused
+  unsigned long long fusion_hits[NUM_FUSIONS];
+
+  // Translator for hot code, NULL unless it was set up with init_jit
+  struct Jit* jit;
+  // Execution counts per opcode and address, NULL unless profiling
+  struct Profile* profile;
+  // Shadow call stack, NULL unless profiling calls
+  struct Call_profile* call_profile;
+
   // Internal registers - for internal use only
   // IR not only tracks the current opcode, but at what stage of the opcode we
   // are, by using the 2 lower bits, since the opcode is shifted 3 bits to the right
@@ -73,11 +158,12 @@ typedef struct {
   // External lines (RW)
   volatile uint16_t* addr_bus;
   volatile uint8_t* data_bus;
-  volatile bool *IRQ;
-  volatile bool *NMI;
-  volatile bool *RES;
-  volatile bool *RDY;
-  volatile bool *SO;
+
+  // Input lines (IRQ, NMI, RES, RDY, SO), as LINE_ bits set by the devices
+  // through cpu_set_line. Only looked at on instruction boundaries, where the
+  // ones needing attention on every cycle get copied to cycle_lines
+  volatile uint8_t lines;
+  uint8_t cycle_lines;
 
   // External lines (RDONLY)
   bool RW;
@@ -102,8 +188,11 @@ typedef struct {
   Clock phi2;
 } M6502;
 
+// Everything the CPU needs to pick up where it was, as stored in savestates.
+// The memory is saved by its owners
 struct M6502_State {
   unsigned long long int tick_count;
+  unsigned long long int instructions;
   uint8_t A;
   uint8_t X;
   uint8_t Y;
@@ -117,17 +206,24 @@ struct M6502_State {
   uint16_t AD;
   uint16_t addr_bus;
   uint8_t data_bus;
-  uint8_t mem[MEMSIZE];
+  uint8_t lines;
+  uint8_t cycle_lines;
+  uint8_t mode;
 } __attribute__((packed));
 
 typedef struct M6502_State M6502_State;
 
 void clock_cpu(void* ptr, bool status);
+unsigned long long clock_cpu_batch(void* ptr, unsigned long long cycles);
+unsigned long long cpu_run_cycles(M6502* cpu, unsigned long long cycles);
 void init_cpu(M6502* cpu);
+void destroy_cpu(M6502* cpu);
 void cpu_cycle(M6502* cpu);
 void cpu_crash(M6502* cpu);
-int save_state(M6502* cpu);
-int load_state(M6502* cpu);
+void cpu_set_line(M6502* cpu, uint8_t line, bool asserted);
+// Only while the CPU isn't running
+void get_cpu_state(M6502* cpu, M6502_State* state);
+void set_cpu_state(M6502* cpu, const M6502_State* state);
 
 // Indexing stuff
 void get_arg_indirect_index(M6502* cpu);
@@ -0,0 +1,661 @@
+/***************************************************************************
+ *   m6502_instr.c  --  This file is part of apple1emu.                    *
+ *                                                                         *
+ *   Copyright (C) 2021 Imanol-Mikel Barba Sabariego                       *
+ *                                                                         *
+ *   apple1emu is free software: you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published     *
+ *   by the Free Software Foundation, either version 3 of the License,     *
+ *   or (at your option) any later version.                                *
+ *                                                                         *
+ *   apple1emu is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty           *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.               *
+ *   See the GNU General Public License for more details.                  *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "m6502.h"
+#include "m6502_opcodes.h"
+#include "m6502_instr.h"
+#include "m6502_jit.h"
+#include "m6502_profile.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Instruction-granular engine. Instead of stepping every opcode one cycle at a
+// time, this resolves the whole instruction on a single call and accounts for
+// the cycles arithmetically. Only the bus accesses that actually move data are
+// performed, so the intermediate (dummy) reads and writes of the real chip are
+// not visible to the rest of the system.
+
+extern Opcode* opcodes[0x100];
+
+static inline void push(M6502* cpu, uint8_t data) {
+  write_bus(cpu, STACK_TOP_ADDR | cpu->S--, data);
+}
+
+static inline uint8_t pull(M6502* cpu) {
+  return read_bus(cpu, STACK_TOP_ADDR | ++cpu->S);
+}
+
+static inline uint8_t branch_to(M6502* cpu, bool condition, uint16_t addr) {
+  if(!condition) {
+    return 0;
+  }
+  // Taken branches take an extra cycle, and another one if the destination is
+  // in a different page
+  uint8_t extra = ((addr & 0xFF00) == (cpu->PC & 0xFF00)) ? 1 : 2;
+  if(cpu->jit != NULL && addr < cpu->PC) {
+    // Loops are what make code worth translating
+    jit_count_branch(cpu->jit, addr);
+  }
+  cpu->PC = addr;
+  return extra;
+}
+
+static void interrupt(M6502* cpu) {
+  uint16_t vector;
+  bool reset = cpu->break_status & BRK_RST;
+  if(reset) {
+    // RST goes through the same sequence, but with the writes disabled, so the
+    // stack pointer still moves
+    cpu->S -= 3;
+    vector = RESET_VECTOR_ADDR;
+  } else {
+    push(cpu, *cpu->PCH);
+    push(cpu, *cpu->PCL);
+    push(cpu, cpu->status | STATUS_BF | STATUS_XF);
+    if(cpu->break_status & BRK_NMI) {
+      vector = NMI_VECTOR_ADDR;
+    } else {
+      vector = IRQ_VECTOR_ADDR;
+    }
+  }
+  cpu->break_status = 0;
+  cpu->status |= STATUS_IF;
+  uint8_t low = read_bus(cpu, vector);
+  cpu->PC = read_bus(cpu, vector + 1) << 8 | low;
+  if(cpu->call_profile != NULL) {
+    profile_interrupt(cpu->call_profile, reset, cpu->PC, cpu->S);
+  }
+}
+
+const uint8_t instruction_length[] = {
+  [ADDR_IMPLICIT] = 1,
+  [ADDR_ACCUMULATOR] = 1,
+  [ADDR_IMMEDIATE] = 2,
+  [ADDR_ZPG] = 2,
+  [ADDR_ZPG_X] = 2,
+  [ADDR_ZPG_Y] = 2,
+  [ADDR_RELATIVE] = 2,
+  [ADDR_ABSOLUTE] = 3,
+  [ADDR_ABSOLUTE_X] = 3,
+  [ADDR_ABSOLUTE_Y] = 3,
+  [ADDR_INDIRECT] = 3,
+  [ADDR_INDEX_IND] = 2,
+  [ADDR_IND_INDEX] = 2
+};
+
+static inline void decode(M6502* cpu, uint16_t addr, uint8_t opcode, Decoded_instr* d) {
+  Opcode* op = opcodes[opcode];
+  d->instr = op->instr;
+  d->opcode = opcode;
+  d->addr_mode = op->addr_mode;
+  d->cycles = op->cycles;
+  d->write = op->write;
+  d->operand = 0;
+  d->length = instruction_length[op->addr_mode];
+  if(d->length > 1) {
+    d->operand = read_bus(cpu, addr + 1);
+  }
+  if(d->length > 2) {
+    d->operand |= read_bus(cpu, addr + 2) << 8;
+  }
+}
+
+// The second instruction of every fusion, and what the first has to be
+static const struct {
+  uint8_t first;
+  uint8_t second;
+} fusions[NUM_FUSIONS] = {
+  [FUSION_CMP_BNE] = {0xC9, 0xD0},
+  [FUSION_LDA_STA] = {0xA5, 0x85},
+  [FUSION_INX_BNE] = {0xE8, 0xD0},
+  [FUSION_DEY_BPL] = {0x88, 0x10}
+};
+
+static const char* fusion_names[NUM_FUSIONS] = {
+  [FUSION_CMP_BNE] = "CMP #imm / BNE",
+  [FUSION_LDA_STA] = "LDA zp / STA zp",
+  [FUSION_INX_BNE] = "INX / BNE",
+  [FUSION_DEY_BPL] = "DEY / BPL"
+};
+
+// Looks for the instruction following a freshly decoded one to make a fusion,
+// only for cached instructions, so that this is done once
+static inline void fuse(M6502* cpu, uint16_t addr, Decoded_instr* d) {
+  d->fusion = FUSION_NONE;
+  uint16_t next = addr + d->length;
+  for(unsigned int i = 1; i < NUM_FUSIONS; ++i) {
+    if(fusions[i].first != d->opcode) {
+      continue;
+    }
+    // The second one is 2 bytes long in every fusion, and has to be in
+    // cacheable memory too so that writes to it drop this one
+    if(!cpu->cacheable[next >> 8] || !cpu->cacheable[(uint16_t)(next + 1) >> 8]) {
+      return;
+    }
+    if(read_bus(cpu, next) != fusions[i].second) {
+      return;
+    }
+    d->fusion = i;
+    d->fused_operand = read_bus(cpu, next + 1);
+    d->fused_length = d->length + 2;
+    return;
+  }
+}
+
+// Runs both instructions of a fusion, as if they were run one after another,
+// and returns the cycles they took
+static unsigned int run_fused(M6502* cpu, Decoded_instr* d) {
+  cpu->fusion_hits[d->fusion]++;
+  // Only the first one was counted when it started
+  cpu->instructions++;
+  cpu->PC += d->fused_length;
+  uint16_t target = cpu->PC + (int8_t)d->fused_operand;
+  switch(d->fusion) {
+    case FUSION_CMP_BNE:
+      do_CMP(cpu, cpu->A, d->operand);
+      return 4 + branch_to(cpu, !(cpu->status & STATUS_ZF), target);
+    case FUSION_LDA_STA:
+      cpu->A = read_bus(cpu, d->operand);
+      update_flags_register(cpu, cpu->A);
+      write_bus(cpu, d->fused_operand, cpu->A);
+      return 6;
+    case FUSION_INX_BNE:
+      update_flags_register(cpu, ++cpu->X);
+      return 4 + branch_to(cpu, !(cpu->status & STATUS_ZF), target);
+    case FUSION_DEY_BPL:
+      update_flags_register(cpu, --cpu->Y);
+      return 4 + branch_to(cpu, !(cpu->status & STATUS_NF), target);
+  }
+  return 0;
+}
+
+// Resolves the effective address of a decoded instruction, once PC has been
+// moved past it. Page crossing penalties are added to cycles.
+static inline uint16_t get_address(M6502* cpu, Decoded_instr* d, unsigned int* cycles) {
+  uint16_t addr;
+  uint8_t index;
+  uint8_t low;
+  switch(d->addr_mode) {
+    case ADDR_IMMEDIATE:
+      return cpu->PC - 1;
+    case ADDR_ZPG:
+    case ADDR_ABSOLUTE:
+      return d->operand;
+    case ADDR_ZPG_X:
+      return (d->operand + cpu->X) & 0x00FF;
+    case ADDR_ZPG_Y:
+      return (d->operand + cpu->Y) & 0x00FF;
+    case ADDR_RELATIVE:
+      return cpu->PC + (int8_t)d->operand;
+    case ADDR_ABSOLUTE_X:
+    case ADDR_ABSOLUTE_Y:
+      index = d->addr_mode == ADDR_ABSOLUTE_X ? cpu->X : cpu->Y;
+      if(!d->write && (((d->operand & 0x00FF) + index) & 0xFF00)) {
+        // Same as in get_arg_absolute_index, writes always take the extra cycle
+        (*cycles)++;
+      }
+      return d->operand + index;
+    case ADDR_INDIRECT:
+      low = read_bus(cpu, d->operand);
+      // The high byte doesn't carry into the next page
+      return read_bus(cpu, (d->operand & 0xFF00) | ((d->operand + 1) & 0x00FF)) << 8 | low;
+    case ADDR_INDEX_IND:
+      addr = (d->operand + cpu->X) & 0x00FF;
+      low = read_bus(cpu, addr);
+      return read_bus(cpu, (addr + 1) & 0x00FF) << 8 | low;
+    case ADDR_IND_INDEX:
+      low = read_bus(cpu, d->operand);
+      addr = read_bus(cpu, (d->operand + 1) & 0x00FF) << 8 | low;
+      if(!d->write && (((addr & 0x00FF) + cpu->Y) & 0xFF00)) {
+        (*cycles)++;
+      }
+      return addr + cpu->Y;
+  }
+  // Implicit and accumulator don't have operands
+  return 0;
+}
+
+unsigned int run_instruction(M6502* cpu) {
+  unsigned int cycles;
+  cpu->SYNC = false;
+  if(cpu->break_status) {
+    // Same as the cycle-stepped core, a pending interrupt takes the place of
+    // the fetched opcode
+    cpu->IR = 0x00;
+    interrupt(cpu);
+    cycles = 7;
+  } else if(cpu->jit == NULL || cpu->profile != NULL || cpu->call_profile != NULL || !(cycles = run_translated(cpu))) {
+    // Nothing translated at PC (or it bailed out right away), interpret it.
+    // Same when profiling, which needs to see every instruction
+    Decoded_instr uncached;
+    Decoded_instr* d = &uncached;
+    uncached.length = 0;
+    if(cpu->decode_cache != NULL && cpu->cacheable[cpu->PC >> 8] && cpu->cacheable[(uint16_t)(cpu->PC + 2) >> 8]) {
+      d = &cpu->decode_cache[cpu->PC];
+    }
+    // The opcode is on the data bus anyway, so double check it
+    if(!d->length || d->opcode != *cpu->data_bus) {
+      decode(cpu, cpu->PC, *cpu->data_bus, d);
+      uncached.fusion = FUSION_NONE;
+      if(d != &uncached) {
+        fuse(cpu, cpu->PC, d);
+      }
+    }
+    cpu->IR = d->opcode << 3;
+    if(d->fusion && !cpu->lines && cpu->profile == NULL && cpu->call_profile == NULL &&
+       !(cpu->break_enabled && cpu->break_addr == (uint16_t)(cpu->PC + d->length))) {
+      // Unless there's a breakpoint on the second one, an asserted line that
+      // could need servicing in between, or a profile that has to see both
+      cycles = run_fused(cpu, d);
+    } else {
+      cpu->PC += d->length;
+      cycles = d->cycles;
+      uint16_t addr = get_address(cpu, d, &cycles);
+      cycles += (*d->instr)(cpu, addr);
+    }
+  }
+  // Leave the bus the way the cycle-stepped core expects it at the end of an
+  // instruction, so that we can switch between both at any SYNC
+  cpu->RW = true;
+  fetch(cpu);
+  return cycles;
+}
+
+void allow_decode_cache(M6502* cpu, uint16_t start, uint16_t end) {
+  // Only whole pages, so that the check on every instruction stays cheap
+  for(unsigned int page = 0; page < NUM_PAGES; ++page) {
+    if(page * PAGE_SIZE >= start && page * PAGE_SIZE + PAGE_SIZE - 1 <= end) {
+      cpu->cacheable[page] = true;
+    }
+  }
+}
+
+void invalidate_decoded(void* ptr, uint16_t addr) {
+  M6502* cpu = (M6502*)ptr;
+  if(cpu->jit != NULL) {
+    jit_invalidate(cpu->jit, addr);
+  }
+  if(cpu->decode_cache == NULL) {
+    return;
+  }
+  // Instructions are up to 3 bytes long, so the write could also be hitting
+  // the operands of the ones starting at the 2 previous addresses. Fusions
+  // are up to 4, so one more
+  cpu->decode_cache[addr].length = 0;
+  cpu->decode_cache[(uint16_t)(addr - 1)].length = 0;
+  cpu->decode_cache[(uint16_t)(addr - 2)].length = 0;
+  cpu->decode_cache[(uint16_t)(addr - 3)].length = 0;
+}
+
+void flush_decoded(M6502* cpu) {
+  if(cpu->jit != NULL) {
+    jit_flush(cpu->jit);
+  }
+  if(cpu->decode_cache != NULL) {
+    memset(cpu->decode_cache, 0x00, MEMSIZE * sizeof(Decoded_instr));
+  }
+}
+
+uint8_t instr_XX(M6502* cpu, uint16_t addr) {
+  fprintf(stderr, "Unknown opcode: 0x%02X\n", cpu->IR >> 3);
+  cpu_crash(cpu);
+  return 0;
+}
+
+uint8_t instr_ADC(M6502* cpu, uint16_t addr) {
+  read_bus(cpu, addr);
+  do_ADC(cpu);
+  return 0;
+}
+
+uint8_t instr_AND(M6502* cpu, uint16_t addr) {
+  read_bus(cpu, addr);
+  do_AND(cpu);
+  return 0;
+}
+
+uint8_t instr_ASL(M6502* cpu, uint16_t addr) {
+  write_bus(cpu, addr, do_ASL(cpu, read_bus(cpu, addr)));
+  return 0;
+}
+
+uint8_t instr_ASL_A(M6502* cpu, uint16_t addr) {
+  cpu->A = do_ASL(cpu, cpu->A);
+  return 0;
+}
+
+uint8_t instr_BCC(M6502* cpu, uint16_t addr) {
+  return branch_to(cpu, !(cpu->status & STATUS_CF), addr);
+}
+
+uint8_t instr_BCS(M6502* cpu, uint16_t addr) {
+  return branch_to(cpu, cpu->status & STATUS_CF, addr);
+}
+
+uint8_t instr_BEQ(M6502* cpu, uint16_t addr) {
+  return branch_to(cpu, cpu->status & STATUS_ZF, addr);
+}
+
+uint8_t instr_BIT(M6502* cpu, uint16_t addr) {
+  read_bus(cpu, addr);
+  do_BIT(cpu);
+  return 0;
+}
+
+uint8_t instr_BMI(M6502* cpu, uint16_t addr) {
+  return branch_to(cpu, cpu->status & STATUS_NF, addr);
+}
+
+uint8_t instr_BNE(M6502* cpu, uint16_t addr) {
+  return branch_to(cpu, !(cpu->status & STATUS_ZF), addr);
+}
+
+uint8_t instr_BPL(M6502* cpu, uint16_t addr) {
+  return branch_to(cpu, !(cpu->status & STATUS_NF), addr);
+}
+
+uint8_t instr_BRK(M6502* cpu, uint16_t addr) {
+  // addr points to the break mark, which we've already skipped
+  fprintf(stderr, "Triggered software BRK, reason: 0x%02X\n", read_bus(cpu, addr));
+  interrupt(cpu);
+  return 0;
+}
+
+uint8_t instr_BVC(M6502* cpu, uint16_t addr) {
+  return branch_to(cpu, !(cpu->status & STATUS_VF), addr);
+}
+
+uint8_t instr_BVS(M6502* cpu, uint16_t addr) {
+  return branch_to(cpu, cpu->status & STATUS_VF, addr);
+}
+
+uint8_t instr_CLC(M6502* cpu, uint16_t addr) {
+  cpu->status &= ~STATUS_CF;
+  return 0;
+}
+
+uint8_t instr_CLD(M6502* cpu, uint16_t addr) {
+  cpu->status &= ~STATUS_DF;
+  return 0;
+}
+
+uint8_t instr_CLI(M6502* cpu, uint16_t addr) {
+  cpu->status &= ~STATUS_IF;
+  return 0;
+}
+
+uint8_t instr_CLV(M6502* cpu, uint16_t addr) {
+  cpu->status &= ~STATUS_VF;
+  return 0;
+}
+
+uint8_t instr_CMP(M6502* cpu, uint16_t addr) {
+  do_CMP(cpu, cpu->A, read_bus(cpu, addr));
+  return 0;
+}
+
+uint8_t instr_CPX(M6502* cpu, uint16_t addr) {
+  do_CMP(cpu, cpu->X, read_bus(cpu, addr));
+  return 0;
+}
+
+uint8_t instr_CPY(M6502* cpu, uint16_t addr) {
+  do_CMP(cpu, cpu->Y, read_bus(cpu, addr));
+  return 0;
+}
+
+uint8_t instr_DEC(M6502* cpu, uint16_t addr) {
+  uint8_t value = read_bus(cpu, addr) - 1;
+  update_flags_register(cpu, value);
+  write_bus(cpu, addr, value);
+  return 0;
+}
+
+uint8_t instr_DEX(M6502* cpu, uint16_t addr) {
+  cpu->X--;
+  update_flags_register(cpu, cpu->X);
+  return 0;
+}
+
+uint8_t instr_DEY(M6502* cpu, uint16_t addr) {
+  cpu->Y--;
+  update_flags_register(cpu, cpu->Y);
+  return 0;
+}
+
+uint8_t instr_EOR(M6502* cpu, uint16_t addr) {
+  read_bus(cpu, addr);
+  do_EOR(cpu);
+  return 0;
+}
+
+uint8_t instr_INC(M6502* cpu, uint16_t addr) {
+  uint8_t value = read_bus(cpu, addr) + 1;
+  update_flags_register(cpu, value);
+  write_bus(cpu, addr, value);
+  return 0;
+}
+
+uint8_t instr_INX(M6502* cpu, uint16_t addr) {
+  cpu->X++;
+  update_flags_register(cpu, cpu->X);
+  return 0;
+}
+
+uint8_t instr_INY(M6502* cpu, uint16_t addr) {
+  cpu->Y++;
+  update_flags_register(cpu, cpu->Y);
+  return 0;
+}
+
+uint8_t instr_JMP(M6502* cpu, uint16_t addr) {
+  cpu->PC = addr;
+  return 0;
+}
+
+uint8_t instr_JSR(M6502* cpu, uint16_t addr) {
+  // The pushed return address points to the last byte of the JSR
+  cpu->PC--;
+  push(cpu, *cpu->PCH);
+  push(cpu, *cpu->PCL);
+  cpu->PC = addr;
+  if(cpu->call_profile != NULL) {
+    profile_call(cpu->call_profile, cpu->PC, cpu->S);
+  }
+  return 0;
+}
+
+uint8_t instr_LDA(M6502* cpu, uint16_t addr) {
+  read_bus(cpu, addr);
+  do_LD_(cpu, &cpu->A);
+  return 0;
+}
+
+uint8_t instr_LDX(M6502* cpu, uint16_t addr) {
+  read_bus(cpu, addr);
+  do_LD_(cpu, &cpu->X);
+  return 0;
+}
+
+uint8_t instr_LDY(M6502* cpu, uint16_t addr) {
+  read_bus(cpu, addr);
+  do_LD_(cpu, &cpu->Y);
+  return 0;
+}
+
+uint8_t instr_LSR(M6502* cpu, uint16_t addr) {
+  write_bus(cpu, addr, do_LSR(cpu, read_bus(cpu, addr)));
+  return 0;
+}
+
+uint8_t instr_LSR_A(M6502* cpu, uint16_t addr) {
+  cpu->A = do_LSR(cpu, cpu->A);
+  return 0;
+}
+
+uint8_t instr_NOP(M6502* cpu, uint16_t addr) {
+  return 0;
+}
+
+uint8_t instr_ORA(M6502* cpu, uint16_t addr) {
+  read_bus(cpu, addr);
+  do_ORA(cpu);
+  return 0;
+}
+
+uint8_t instr_PHA(M6502* cpu, uint16_t addr) {
+  push(cpu, cpu->A);
+  return 0;
+}
+
+uint8_t instr_PHP(M6502* cpu, uint16_t addr) {
+  push(cpu, cpu->status | STATUS_BF | STATUS_XF);
+  return 0;
+}
+
+uint8_t instr_PLA(M6502* cpu, uint16_t addr) {
+  cpu->A = pull(cpu);
+  update_flags_register(cpu, cpu->A);
+  return 0;
+}
+
+uint8_t instr_PLP(M6502* cpu, uint16_t addr) {
+  cpu->status = (pull(cpu) | STATUS_BF) & ~STATUS_BF;
+  return 0;
+}
+
+uint8_t instr_ROL(M6502* cpu, uint16_t addr) {
+  write_bus(cpu, addr, do_ROL(cpu, read_bus(cpu, addr)));
+  return 0;
+}
+
+uint8_t instr_ROL_A(M6502* cpu, uint16_t addr) {
+  cpu->A = do_ROL(cpu, cpu->A);
+  return 0;
+}
+
+uint8_t instr_ROR(M6502* cpu, uint16_t addr) {
+  write_bus(cpu, addr, do_ROR(cpu, read_bus(cpu, addr)));
+  return 0;
+}
+
+uint8_t instr_ROR_A(M6502* cpu, uint16_t addr) {
+  cpu->A = do_ROR(cpu, cpu->A);
+  return 0;
+}
+
+uint8_t instr_RTI(M6502* cpu, uint16_t addr) {
+  cpu->status = (pull(cpu) | STATUS_BF) & ~STATUS_XF;
+  *cpu->PCL = pull(cpu);
+  *cpu->PCH = pull(cpu);
+  if(cpu->call_profile != NULL) {
+    profile_return(cpu->call_profile, cpu->S);
+  }
+  return 0;
+}
+
+uint8_t instr_RTS(M6502* cpu, uint16_t addr) {
+  *cpu->PCL = pull(cpu);
+  *cpu->PCH = pull(cpu);
+  cpu->PC++;
+  if(cpu->call_profile != NULL) {
+    profile_return(cpu->call_profile, cpu->S);
+  }
+  return 0;
+}
+
+uint8_t instr_SBC(M6502* cpu, uint16_t addr) {
+  read_bus(cpu, addr);
+  do_SBC(cpu);
+  return 0;
+}
+
+uint8_t instr_SEC(M6502* cpu, uint16_t addr) {
+  cpu->status |= STATUS_CF;
+  return 0;
+}
+
+uint8_t instr_SED(M6502* cpu, uint16_t addr) {
+  cpu->status |= STATUS_DF;
+  return 0;
+}
+
+uint8_t instr_SEI(M6502* cpu, uint16_t addr) {
+  cpu->status |= STATUS_IF;
+  return 0;
+}
+
+uint8_t instr_STA(M6502* cpu, uint16_t addr) {
+  write_bus(cpu, addr, cpu->A);
+  return 0;
+}
+
+uint8_t instr_STX(M6502* cpu, uint16_t addr) {
+  write_bus(cpu, addr, cpu->X);
+  return 0;
+}
+
+uint8_t instr_STY(M6502* cpu, uint16_t addr) {
+  write_bus(cpu, addr, cpu->Y);
+  return 0;
+}
+
+uint8_t instr_TAX(M6502* cpu, uint16_t addr) {
+  cpu->X = cpu->A;
+  update_flags_register(cpu, cpu->X);
+  return 0;
+}
+
+uint8_t instr_TAY(M6502* cpu, uint16_t addr) {
+  cpu->Y = cpu->A;
+  update_flags_register(cpu, cpu->Y);
+  return 0;
+}
+
+uint8_t instr_TSX(M6502* cpu, uint16_t addr) {
+  cpu->X = cpu->S;
+  update_flags_register(cpu, cpu->X);
+  return 0;
+}
+
+uint8_t instr_TXA(M6502* cpu, uint16_t addr) {
+  cpu->A = cpu->X;
+  update_flags_register(cpu, cpu->A);
+  return 0;
+}
+
+uint8_t instr_TXS(M6502* cpu, uint16_t addr) {
+  cpu->S = cpu->X;
+  return 0;
+}
+
+uint8_t instr_TYA(M6502* cpu, uint16_t addr) {
+  cpu->A = cpu->Y;
+  update_flags_register(cpu, cpu->A);
+  return 0;
+}
+
+void print_fusion_stats(M6502* cpu) {
+  fprintf(stderr, "== FUSIONS ==\n");
+  for(unsigned int i = 1; i < NUM_FUSIONS; ++i) {
+    fprintf(stderr, "%-16s %llu\n", fusion_names[i], cpu->fusion_hits[i]);
+  }
+}
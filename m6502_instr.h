@@ -0,0 +1,127 @@
+/***************************************************************************
+ *   m6502_instr.h  --  This file is part of apple1emu.                    *
+ *                                                                         *
+ *   Copyright (C) 2021 Imanol-Mikel Barba Sabariego                       *
+ *                                                                         *
+ *   apple1emu is free software: you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published     *
+ *   by the Free Software Foundation, either version 3 of the License,     *
+ *   or (at your option) any later version.                                *
+ *                                                                         *
+ *   apple1emu is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty           *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.               *
+ *   See the GNU General Public License for more details.                  *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef M6502_INSTR_H
+#define M6502_INSTR_H
+
+#include "m6502.h"
+#include "m6502_opcodes.h"
+
+// Bus accesses for the instruction-level engine, without the intermediate
+// cycles of the real chip
+static inline uint8_t read_bus(M6502* cpu, uint16_t addr) {
+  *cpu->addr_bus = addr;
+  cpu->RW = true;
+  tick(&cpu->phi2);
+  return *cpu->data_bus;
+}
+
+static inline void write_bus(M6502* cpu, uint16_t addr, uint8_t data) {
+  *cpu->addr_bus = addr;
+  *cpu->data_bus = data;
+  cpu->RW = false;
+  tick(&cpu->phi2);
+}
+
+// Bytes taken by an instruction, by addressing mode
+extern const uint8_t instruction_length[];
+
+// Runs a whole instruction (or interrupt sequence) in one go, starting at an
+// instruction boundary with the opcode already on the data bus, just like the
+// cycle-stepped core would find it. Returns the number of cycles it took.
+unsigned int run_instruction(M6502* cpu);
+
+// Decoded instructions are cached for the pages fully within [start, end],
+// which have to be backed by memory calling invalidate_decoded on writes
+void allow_decode_cache(M6502* cpu, uint16_t start, uint16_t end);
+void invalidate_decoded(void* ptr, uint16_t addr);
+// Drops every decoded and translated instruction, for when the memory changed
+// behind the bus
+void flush_decoded(M6502* cpu);
+
+// Times every pair of instructions ran as one, to stderr
+void print_fusion_stats(M6502* cpu);
+
+// Instruction handlers. They get the effective address already resolved
+// according to the addressing mode of the opcode, and return the extra cycles
+// taken on top of the base count in the opcode table (taken branches)
+uint8_t instr_XX(M6502* cpu, uint16_t addr);
+uint8_t instr_ADC(M6502* cpu, uint16_t addr);
+uint8_t instr_AND(M6502* cpu, uint16_t addr);
+uint8_t instr_ASL(M6502* cpu, uint16_t addr);
+uint8_t instr_ASL_A(M6502* cpu, uint16_t addr);
+uint8_t instr_BCC(M6502* cpu, uint16_t addr);
+uint8_t instr_BCS(M6502* cpu, uint16_t addr);
+uint8_t instr_BEQ(M6502* cpu, uint16_t addr);
+uint8_t instr_BIT(M6502* cpu, uint16_t addr);
+uint8_t instr_BMI(M6502* cpu, uint16_t addr);
+uint8_t instr_BNE(M6502* cpu, uint16_t addr);
+uint8_t instr_BPL(M6502* cpu, uint16_t addr);
+uint8_t instr_BRK(M6502* cpu, uint16_t addr);
+uint8_t instr_BVC(M6502* cpu, uint16_t addr);
+uint8_t instr_BVS(M6502* cpu, uint16_t addr);
+uint8_t instr_CLC(M6502* cpu, uint16_t addr);
+uint8_t instr_CLD(M6502* cpu, uint16_t addr);
+uint8_t instr_CLI(M6502* cpu, uint16_t addr);
+uint8_t instr_CLV(M6502* cpu, uint16_t addr);
+uint8_t instr_CMP(M6502* cpu, uint16_t addr);
+uint8_t instr_CPX(M6502* cpu, uint16_t addr);
+uint8_t instr_CPY(M6502* cpu, uint16_t addr);
+uint8_t instr_DEC(M6502* cpu, uint16_t addr);
+uint8_t instr_DEX(M6502* cpu, uint16_t addr);
+uint8_t instr_DEY(M6502* cpu, uint16_t addr);
+uint8_t instr_EOR(M6502* cpu, uint16_t addr);
+uint8_t instr_INC(M6502* cpu, uint16_t addr);
+uint8_t instr_INX(M6502* cpu, uint16_t addr);
+uint8_t instr_INY(M6502* cpu, uint16_t addr);
+uint8_t instr_JMP(M6502* cpu, uint16_t addr);
+uint8_t instr_JSR(M6502* cpu, uint16_t addr);
+uint8_t instr_LDA(M6502* cpu, uint16_t addr);
+uint8_t instr_LDX(M6502* cpu, uint16_t addr);
+uint8_t instr_LDY(M6502* cpu, uint16_t addr);
+uint8_t instr_LSR(M6502* cpu, uint16_t addr);
+uint8_t instr_LSR_A(M6502* cpu, uint16_t addr);
+uint8_t instr_NOP(M6502* cpu, uint16_t addr);
+uint8_t instr_ORA(M6502* cpu, uint16_t addr);
+uint8_t instr_PHA(M6502* cpu, uint16_t addr);
+uint8_t instr_PHP(M6502* cpu, uint16_t addr);
+uint8_t instr_PLA(M6502* cpu, uint16_t addr);
+uint8_t instr_PLP(M6502* cpu, uint16_t addr);
+uint8_t instr_ROL(M6502* cpu, uint16_t addr);
+uint8_t instr_ROL_A(M6502* cpu, uint16_t addr);
+uint8_t instr_ROR(M6502* cpu, uint16_t addr);
+uint8_t instr_ROR_A(M6502* cpu, uint16_t addr);
+uint8_t instr_RTI(M6502* cpu, uint16_t addr);
+uint8_t instr_RTS(M6502* cpu, uint16_t addr);
+uint8_t instr_SBC(M6502* cpu, uint16_t addr);
+uint8_t instr_SEC(M6502* cpu, uint16_t addr);
+uint8_t instr_SED(M6502* cpu, uint16_t addr);
+uint8_t instr_SEI(M6502* cpu, uint16_t addr);
+uint8_t instr_STA(M6502* cpu, uint16_t addr);
+uint8_t instr_STX(M6502* cpu, uint16_t addr);
+uint8_t instr_STY(M6502* cpu, uint16_t addr);
+uint8_t instr_TAX(M6502* cpu, uint16_t addr);
+uint8_t instr_TAY(M6502* cpu, uint16_t addr);
+uint8_t instr_TSX(M6502* cpu, uint16_t addr);
+uint8_t instr_TXA(M6502* cpu, uint16_t addr);
+uint8_t instr_TXS(M6502* cpu, uint16_t addr);
+uint8_t instr_TYA(M6502* cpu, uint16_t addr);
+
+#endif
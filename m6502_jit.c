@@ -0,0 +1,799 @@
+/***************************************************************************
+ *   m6502_jit.c  --  This file is part of apple1emu.                      *
+ *                                                                         *
+ *   Copyright (C) 2021 Imanol-Mikel Barba Sabariego                       *
+ *                                                                         *
+ *   apple1emu is free software: you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published     *
+ *   by the Free Software Foundation, either version 3 of the License,     *
+ *   or (at your option) any later version.                                *
+ *                                                                         *
+ *   apple1emu is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty           *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.               *
+ *   See the GNU General Public License for more details.                  *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "m6502.h"
+#include "m6502_opcodes.h"
+#include "m6502_instr.h"
+#include "m6502_jit.h"
+#include "errors.h"
+
+#include <stdio.h>
+
+#if defined(APPLE1_JIT) && defined(__x86_64__)
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <pthread.h>
+
+// Basic-block translator for the instruction-level engine. Hot blocks get
+// compiled to x86-64 functions that keep the CPU in rbx, the cycles taken so
+// far in r12d, the N/Z flags table in r13 and the cycles they're allowed to run
+// for in r14d. Register and flag instructions
+// and branches are emitted inline, anything touching memory calls the handler
+// of the instruction-level engine with the effective address computed in the
+// block, so the bus behaves exactly the same as when interpreting. A block
+// ends on the first control flow instruction, and bails out to the
+// interpreter right before any access to the I/O range. Before every
+// instruction but the first it also leaves if it ran out of cycles, or a line
+// got asserted or the CPU was asked to return, so that it never runs past
+// the next event or an interrupt.
+//
+// The code buffer is never writable and executable at once: the pages a
+// block goes into are only made writable while translating it.
+
+extern Opcode* opcodes[0x100];
+
+#define CPU_FIELD(field) ((uint32_t)offsetof(M6502, field))
+// Upper bound of the native code emitted for a single instruction
+#define MAX_INSTRUCTION_CODE 256
+// Upper bound for a whole block, exits and all
+#define BLOCK_CODE_SIZE ((JIT_MAX_BLOCK_INSTRUCTIONS + 1) * MAX_INSTRUCTION_CODE)
+#define EPILOGUE_SIZE 13
+#define EXIT_SIZE (9 + EPILOGUE_SIZE)
+#define ADD_CYCLES_SIZE 7
+// Blocks count the guest instructions they ran in the upper half of r12d
+#define BLOCK_INSTRUCTION 0x10000
+
+#define X86_AND 0x24
+#define X86_OR 0x0C
+#define X86_XOR 0x34
+
+enum emit_result {
+  EMIT_NONE = 0,
+  EMIT_CONTINUE = 1,
+  EMIT_END = 2
+};
+
+// Status flags to OR in after loading a value into a register. Shared by the
+// translators of every CPU
+static uint8_t nz_flags[0x100];
+static pthread_once_t nz_flags_once = PTHREAD_ONCE_INIT;
+
+static void init_nz_flags() {
+  for(unsigned int i = 0; i < 0x100; ++i) {
+    nz_flags[i] = (i & STATUS_NF) ? STATUS_NF : (!i ? STATUS_ZF : 0);
+  }
+}
+
+static void emit(Jit* jit, int count, ...) {
+  va_list bytes;
+  va_start(bytes, count);
+  for(int i = 0; i < count; ++i) {
+    jit->code[jit->code_used++] = (uint8_t)va_arg(bytes, int);
+  }
+  va_end(bytes);
+}
+
+static void emit16(Jit* jit, uint16_t value) {
+  memcpy(jit->code + jit->code_used, &value, sizeof(value));
+  jit->code_used += sizeof(value);
+}
+
+static void emit32(Jit* jit, uint32_t value) {
+  memcpy(jit->code + jit->code_used, &value, sizeof(value));
+  jit->code_used += sizeof(value);
+}
+
+static void emit64(Jit* jit, uint64_t value) {
+  memcpy(jit->code + jit->code_used, &value, sizeof(value));
+  jit->code_used += sizeof(value);
+}
+
+static void emit_prologue(Jit* jit) {
+  // push rbx; push r12; push r13; push r14; push r15 (unused, but it keeps the
+  // stack aligned for the calls)
+  emit(jit, 9, 0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57);
+  // mov rbx, rdi; xor r12d, r12d; mov r14d, esi
+  emit(jit, 9, 0x48, 0x89, 0xFB, 0x45, 0x31, 0xE4, 0x41, 0x89, 0xF6);
+  // mov r13, nz_flags
+  emit(jit, 2, 0x49, 0xBD);
+  emit64(jit, (uintptr_t)nz_flags);
+}
+
+static void emit_epilogue(Jit* jit) {
+  // mov eax, r12d; pop r15; pop r14; pop r13; pop r12; pop rbx; ret
+  emit(jit, EPILOGUE_SIZE, 0x44, 0x89, 0xE0, 0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3);
+}
+
+static void emit_store_pc(Jit* jit, uint16_t pc) {
+  // mov word [rbx+PC], pc
+  emit(jit, 3, 0x66, 0xC7, 0x83);
+  emit32(jit, CPU_FIELD(PC));
+  emit16(jit, pc);
+}
+
+// Leaves the block, carrying on from pc. Always EXIT_SIZE bytes
+static void emit_exit(Jit* jit, uint16_t pc) {
+  emit_store_pc(jit, pc);
+  emit_epilogue(jit);
+}
+
+// Every guest instruction ends with one of these. Always ADD_CYCLES_SIZE bytes
+static void emit_add_cycles(Jit* jit, uint8_t cycles) {
+  // add r12d, BLOCK_INSTRUCTION + cycles
+  emit(jit, 3, 0x41, 0x81, 0xC4);
+  emit32(jit, BLOCK_INSTRUCTION + cycles);
+}
+
+static void emit_load(Jit* jit, uint32_t field) {
+  // mov al, [rbx+field]
+  emit(jit, 2, 0x8A, 0x83);
+  emit32(jit, field);
+}
+
+static void emit_store(Jit* jit, uint32_t field) {
+  // mov [rbx+field], al
+  emit(jit, 2, 0x88, 0x83);
+  emit32(jit, field);
+}
+
+static void emit_status_and(Jit* jit, uint8_t mask) {
+  // and byte [rbx+status], mask
+  emit(jit, 2, 0x80, 0xA3);
+  emit32(jit, CPU_FIELD(status));
+  emit(jit, 1, mask);
+}
+
+static void emit_status_or(Jit* jit, uint8_t mask) {
+  // or byte [rbx+status], mask
+  emit(jit, 2, 0x80, 0x8B);
+  emit32(jit, CPU_FIELD(status));
+  emit(jit, 1, mask);
+}
+
+// Same as update_flags_register, for the value in al
+static void emit_update_nz(Jit* jit) {
+  // movzx eax, al; mov cl, [r13+rax]
+  emit(jit, 8, 0x0F, 0xB6, 0xC0, 0x41, 0x8A, 0x4C, 0x05, 0x00);
+  emit_status_and(jit, (uint8_t)~(STATUS_NF | STATUS_ZF));
+  // or [rbx+status], cl
+  emit(jit, 2, 0x08, 0x8B);
+  emit32(jit, CPU_FIELD(status));
+}
+
+static void emit_mov_esi(Jit* jit, uint32_t value) {
+  // mov esi, value
+  emit(jit, 1, 0xBE);
+  emit32(jit, value);
+}
+
+// Calls func(cpu, esi, edx), clobbering every caller-saved register
+static void emit_call(Jit* jit, uintptr_t func) {
+  // mov rdi, rbx; mov rax, func; call rax
+  emit(jit, 5, 0x48, 0x89, 0xDF, 0x48, 0xB8);
+  emit64(jit, func);
+  emit(jit, 2, 0xFF, 0xD0);
+}
+
+// Leaves right before the instruction at pc if the block used up its cycles,
+// or the interpreter has to take over: an asserted line, or a request to
+// return from cpu_run_cycles
+static void emit_boundary_check(Jit* jit, uint16_t pc) {
+  // movzx eax, r12w; cmp eax, r14d; jae exit
+  emit(jit, 9, 0x41, 0x0F, 0xB7, 0xC4, 0x44, 0x39, 0xF0, 0x73, 20);
+  // cmp byte [rbx+lines], 0; jne exit
+  emit(jit, 2, 0x80, 0xBB);
+  emit32(jit, CPU_FIELD(lines));
+  emit(jit, 3, 0x00, 0x75, 11);
+  // cmp byte [rbx+exit_requested], 0; jne exit; jmp skip
+  emit(jit, 2, 0x80, 0xBB);
+  emit32(jit, CPU_FIELD(exit_requested));
+  emit(jit, 5, 0x00, 0x75, 2, 0xEB, EXIT_SIZE);
+  emit_exit(jit, pc);
+}
+
+// Bails out right before the instruction at pc if the address in esi falls in
+// the I/O range, so that the interpreter takes care of it
+static void emit_io_check(Jit* jit, uint16_t pc) {
+  // lea eax, [rsi-io_start]; cmp eax, io_end-io_start; ja skip
+  emit(jit, 2, 0x8D, 0x86);
+  emit32(jit, -(uint32_t)jit->io_start);
+  emit(jit, 1, 0x3D);
+  emit32(jit, jit->io_end - jit->io_start);
+  emit(jit, 2, 0x77, EXIT_SIZE);
+  emit_exit(jit, pc);
+}
+
+// Stops after an instruction that wrote memory if that dropped any block, as
+// the rest of this one might be stale now
+static void emit_invalidation_check(Jit* jit, uint16_t next) {
+  // mov rax, &invalidated; cmp byte [rax], 0; je skip
+  emit(jit, 2, 0x48, 0xB8);
+  emit64(jit, (uintptr_t)&jit->invalidated);
+  emit(jit, 5, 0x80, 0x38, 0x00, 0x74, EXIT_SIZE);
+  emit_exit(jit, next);
+}
+
+static void emit_index(Jit* jit, uint32_t index, uint16_t base, uint32_t mask) {
+  // movzx esi, byte [rbx+index]; add esi, base; and esi, mask
+  emit(jit, 3, 0x0F, 0xB6, 0xB3);
+  emit32(jit, index);
+  emit(jit, 2, 0x81, 0xC6);
+  emit32(jit, base);
+  emit(jit, 2, 0x81, 0xE6);
+  emit32(jit, mask);
+}
+
+static void emit_page_penalty(Jit* jit, uint32_t index, uint16_t base) {
+  // movzx eax, byte [rbx+index]; add eax, base_low; shr eax, 8; add r12d, eax
+  emit(jit, 3, 0x0F, 0xB6, 0x83);
+  emit32(jit, index);
+  emit(jit, 1, 0x05);
+  emit32(jit, base & 0x00FF);
+  emit(jit, 6, 0xC1, 0xE8, 0x08, 0x41, 0x01, 0xC4);
+}
+
+static void emit_transfer(Jit* jit, uint32_t from, uint32_t to, bool flags) {
+  emit_load(jit, from);
+  emit_store(jit, to);
+  if(flags) {
+    emit_update_nz(jit);
+  }
+}
+
+static void emit_step(Jit* jit, uint32_t reg, uint8_t delta) {
+  emit_load(jit, reg);
+  // add al, delta
+  emit(jit, 2, 0x04, delta);
+  emit_store(jit, reg);
+  emit_update_nz(jit);
+}
+
+static void emit_load_immediate(Jit* jit, uint32_t reg, uint8_t value) {
+  // mov byte [rbx+reg], value
+  emit(jit, 2, 0xC6, 0x83);
+  emit32(jit, reg);
+  emit(jit, 1, value);
+  // Flags are known at translation time
+  emit_status_and(jit, (uint8_t)~(STATUS_NF | STATUS_ZF));
+  if(nz_flags[value]) {
+    emit_status_or(jit, nz_flags[value]);
+  }
+}
+
+static void emit_logic_immediate(Jit* jit, uint8_t x86_op, uint8_t value) {
+  emit_load(jit, CPU_FIELD(A));
+  emit(jit, 2, x86_op, value);
+  emit_store(jit, CPU_FIELD(A));
+  emit_update_nz(jit);
+}
+
+// Same as do_CMP
+static void emit_compare_immediate(Jit* jit, uint32_t reg, uint8_t value) {
+  emit_load(jit, reg);
+  // cmp al, value; setae cl; sub al, value
+  emit(jit, 7, 0x3C, value, 0x0F, 0x93, 0xC1, 0x2C, value);
+  // movzx eax, al; or cl, [r13+rax]
+  emit(jit, 8, 0x0F, 0xB6, 0xC0, 0x41, 0x0A, 0x4C, 0x05, 0x00);
+  emit_status_and(jit, (uint8_t)~(STATUS_NF | STATUS_ZF | STATUS_CF));
+  // or [rbx+status], cl
+  emit(jit, 2, 0x08, 0x8B);
+  emit32(jit, CPU_FIELD(status));
+}
+
+// Branches always end the block, both ways leave straight from here
+static void emit_branch(Jit* jit, uint8_t flag, bool if_set, uint8_t cycles, uint16_t next, uint16_t target) {
+  // test byte [rbx+status], flag; jz/jnz not_taken
+  emit(jit, 2, 0xF6, 0x83);
+  emit32(jit, CPU_FIELD(status));
+  emit(jit, 3, flag, if_set ? 0x74 : 0x75, ADD_CYCLES_SIZE + EXIT_SIZE);
+  emit_add_cycles(jit, cycles + (((target & 0xFF00) == (next & 0xFF00)) ? 1 : 2));
+  emit_exit(jit, target);
+  emit_add_cycles(jit, cycles);
+  emit_exit(jit, next);
+}
+
+static uint16_t jit_indirect(M6502* cpu, uint16_t operand) {
+  uint8_t low = read_bus(cpu, operand);
+  // The high byte doesn't carry into the next page
+  return read_bus(cpu, (operand & 0xFF00) | ((operand + 1) & 0x00FF)) << 8 | low;
+}
+
+static uint16_t jit_index_indirect(M6502* cpu, uint16_t operand) {
+  uint16_t addr = (operand + cpu->X) & 0x00FF;
+  uint8_t low = read_bus(cpu, addr);
+  return read_bus(cpu, (addr + 1) & 0x00FF) << 8 | low;
+}
+
+// Returns the page crossing penalty on the upper half
+static uint32_t jit_indirect_index(M6502* cpu, uint16_t operand, bool write) {
+  uint8_t low = read_bus(cpu, operand);
+  uint16_t addr = read_bus(cpu, (operand + 1) & 0x00FF) << 8 | low;
+  uint32_t penalty = (!write && (((addr & 0x00FF) + cpu->Y) & 0xFF00)) ? 1 : 0;
+  return (uint16_t)(addr + cpu->Y) | penalty << 16;
+}
+
+static inline bool is_io(Jit* jit, uint16_t addr) {
+  return addr >= jit->io_start && addr <= jit->io_end;
+}
+
+static bool writes_memory(instr_func instr) {
+  return instr == &instr_STA || instr == &instr_STX || instr == &instr_STY ||
+         instr == &instr_ASL || instr == &instr_LSR || instr == &instr_ROL ||
+         instr == &instr_ROR || instr == &instr_INC || instr == &instr_DEC ||
+         instr == &instr_PHA || instr == &instr_PHP;
+}
+
+static int emit_handler_call(Jit* jit, uint16_t pc, uint8_t opcode, uint16_t operand) {
+  Opcode* op = opcodes[opcode];
+  uint16_t next = pc + instruction_length[op->addr_mode];
+  uint32_t index = CPU_FIELD(X);
+  switch(op->addr_mode) {
+    case ADDR_IMPLICIT:
+    case ADDR_ACCUMULATOR:
+    break;
+    case ADDR_IMMEDIATE:
+      emit_mov_esi(jit, (uint16_t)(pc + 1));
+    break;
+    case ADDR_ZPG:
+    case ADDR_ABSOLUTE:
+      // JSR doesn't access its operand
+      if(opcode != 0x20 && is_io(jit, operand)) {
+        return EMIT_NONE;
+      }
+      emit_mov_esi(jit, operand);
+    break;
+    case ADDR_ZPG_Y:
+      index = CPU_FIELD(Y);
+      // fall through
+    case ADDR_ZPG_X:
+      emit_index(jit, index, operand, 0x00FF);
+      if(jit->io_start < PAGE_SIZE) {
+        emit_io_check(jit, pc);
+      }
+    break;
+    case ADDR_ABSOLUTE_Y:
+      index = CPU_FIELD(Y);
+      // fall through
+    case ADDR_ABSOLUTE_X:
+      emit_index(jit, index, operand, 0xFFFF);
+      emit_io_check(jit, pc);
+      if(!op->write) {
+        emit_page_penalty(jit, index, operand);
+      }
+    break;
+    case ADDR_INDIRECT:
+      if(is_io(jit, operand) || is_io(jit, (operand & 0xFF00) | ((operand + 1) & 0x00FF))) {
+        return EMIT_NONE;
+      }
+      emit_mov_esi(jit, operand);
+      emit_call(jit, (uintptr_t)&jit_indirect);
+      // movzx esi, ax
+      emit(jit, 3, 0x0F, 0xB7, 0xF0);
+    break;
+    case ADDR_INDEX_IND:
+      emit_mov_esi(jit, operand);
+      emit_call(jit, (uintptr_t)&jit_index_indirect);
+      // movzx esi, ax
+      emit(jit, 3, 0x0F, 0xB7, 0xF0);
+      emit_io_check(jit, pc);
+    break;
+    case ADDR_IND_INDEX:
+      emit_mov_esi(jit, operand);
+      // mov edx, write
+      emit(jit, 1, 0xBA);
+      emit32(jit, op->write ? 1 : 0);
+      emit_call(jit, (uintptr_t)&jit_indirect_index);
+      // mov ecx, eax; movzx esi, ax
+      emit(jit, 5, 0x89, 0xC1, 0x0F, 0xB7, 0xF0);
+      emit_io_check(jit, pc);
+      // shr ecx, 16; add r12d, ecx
+      emit(jit, 6, 0xC1, 0xE9, 0x10, 0x41, 0x01, 0xCC);
+    break;
+    default:
+      // Branches are all emitted inline
+      return EMIT_NONE;
+  }
+  if(op->instr == &instr_JSR) {
+    // Pushes the return address out of PC
+    emit_store_pc(jit, next);
+  }
+  emit_call(jit, (uintptr_t)op->instr);
+  emit_add_cycles(jit, op->cycles);
+  if(op->instr == &instr_JSR || op->instr == &instr_JMP || op->instr == &instr_RTS || op->instr == &instr_RTI) {
+    // These already left PC where it has to be
+    emit_epilogue(jit);
+    return EMIT_END;
+  }
+  if(writes_memory(op->instr)) {
+    emit_invalidation_check(jit, next);
+  }
+  return EMIT_CONTINUE;
+}
+
+static int emit_instruction(Jit* jit, uint16_t pc, uint8_t opcode, uint16_t operand) {
+  Opcode* op = opcodes[opcode];
+  uint16_t next = pc + instruction_length[op->addr_mode];
+  switch(opcode) {
+    case 0x00:
+      // BRK is rare enough, and the interpreter takes care of interrupts
+      return EMIT_NONE;
+    case 0x10:
+      emit_branch(jit, STATUS_NF, false, op->cycles, next, next + (int8_t)operand);
+      return EMIT_END;
+    case 0x30:
+      emit_branch(jit, STATUS_NF, true, op->cycles, next, next + (int8_t)operand);
+      return EMIT_END;
+    case 0x50:
+      emit_branch(jit, STATUS_VF, false, op->cycles, next, next + (int8_t)operand);
+      return EMIT_END;
+    case 0x70:
+      emit_branch(jit, STATUS_VF, true, op->cycles, next, next + (int8_t)operand);
+      return EMIT_END;
+    case 0x90:
+      emit_branch(jit, STATUS_CF, false, op->cycles, next, next + (int8_t)operand);
+      return EMIT_END;
+    case 0xB0:
+      emit_branch(jit, STATUS_CF, true, op->cycles, next, next + (int8_t)operand);
+      return EMIT_END;
+    case 0xD0:
+      emit_branch(jit, STATUS_ZF, false, op->cycles, next, next + (int8_t)operand);
+      return EMIT_END;
+    case 0xF0:
+      emit_branch(jit, STATUS_ZF, true, op->cycles, next, next + (int8_t)operand);
+      return EMIT_END;
+    case 0x4C:
+      emit_add_cycles(jit, op->cycles);
+      emit_exit(jit, operand);
+      return EMIT_END;
+    case 0xAA:
+      emit_transfer(jit, CPU_FIELD(A), CPU_FIELD(X), true);
+    break;
+    case 0xA8:
+      emit_transfer(jit, CPU_FIELD(A), CPU_FIELD(Y), true);
+    break;
+    case 0x8A:
+      emit_transfer(jit, CPU_FIELD(X), CPU_FIELD(A), true);
+    break;
+    case 0x98:
+      emit_transfer(jit, CPU_FIELD(Y), CPU_FIELD(A), true);
+    break;
+    case 0xBA:
+      emit_transfer(jit, CPU_FIELD(S), CPU_FIELD(X), true);
+    break;
+    case 0x9A:
+      emit_transfer(jit, CPU_FIELD(X), CPU_FIELD(S), false);
+    break;
+    case 0xE8:
+      emit_step(jit, CPU_FIELD(X), 0x01);
+    break;
+    case 0xC8:
+      emit_step(jit, CPU_FIELD(Y), 0x01);
+    break;
+    case 0xCA:
+      emit_step(jit, CPU_FIELD(X), 0xFF);
+    break;
+    case 0x88:
+      emit_step(jit, CPU_FIELD(Y), 0xFF);
+    break;
+    case 0x18:
+      emit_status_and(jit, (uint8_t)~STATUS_CF);
+    break;
+    case 0x38:
+      emit_status_or(jit, STATUS_CF);
+    break;
+    case 0x58:
+      emit_status_and(jit, (uint8_t)~STATUS_IF);
+    break;
+    case 0x78:
+      emit_status_or(jit, STATUS_IF);
+    break;
+    case 0xB8:
+      emit_status_and(jit, (uint8_t)~STATUS_VF);
+    break;
+    case 0xD8:
+      emit_status_and(jit, (uint8_t)~STATUS_DF);
+    break;
+    case 0xF8:
+      emit_status_or(jit, STATUS_DF);
+    break;
+    case 0xEA:
+    break;
+    case 0xA9:
+      emit_load_immediate(jit, CPU_FIELD(A), operand);
+    break;
+    case 0xA2:
+      emit_load_immediate(jit, CPU_FIELD(X), operand);
+    break;
+    case 0xA0:
+      emit_load_immediate(jit, CPU_FIELD(Y), operand);
+    break;
+    case 0x29:
+      emit_logic_immediate(jit, X86_AND, operand);
+    break;
+    case 0x09:
+      emit_logic_immediate(jit, X86_OR, operand);
+    break;
+    case 0x49:
+      emit_logic_immediate(jit, X86_XOR, operand);
+    break;
+    case 0xC9:
+      emit_compare_immediate(jit, CPU_FIELD(A), operand);
+    break;
+    case 0xE0:
+      emit_compare_immediate(jit, CPU_FIELD(X), operand);
+    break;
+    case 0xC0:
+      emit_compare_immediate(jit, CPU_FIELD(Y), operand);
+    break;
+    default:
+      if(op->instr == &instr_XX) {
+        return EMIT_NONE;
+      }
+      return emit_handler_call(jit, pc, opcode, operand);
+  }
+  emit_add_cycles(jit, op->cycles);
+  return EMIT_CONTINUE;
+}
+
+static void set_page_blocks(Jit* jit, uint16_t start, int delta) {
+  uint8_t first = start >> 8;
+  uint8_t last = (uint16_t)(start + jit->block_length[start] - 1) >> 8;
+  jit->page_blocks[first] += delta;
+  if(last != first) {
+    jit->page_blocks[last] += delta;
+  }
+}
+
+// Changes the protection of the whole pages covering [start, end) of the code
+static int protect_code(Jit* jit, size_t start, size_t end, int prot) {
+  size_t page = sysconf(_SC_PAGESIZE);
+  start &= ~(page - 1);
+  end = (end + page - 1) & ~(page - 1);
+  if(end > JIT_CODE_SIZE) {
+    end = JIT_CODE_SIZE;
+  }
+  if(mprotect(jit->code + start, end - start, prot) == -1) {
+    fprintf(stderr, "Unable to change the protection of the JIT code, turning it off\n");
+    jit->enabled = false;
+    return FAILURE;
+  }
+  return SUCCESS;
+}
+
+static jit_block translate(M6502* cpu, Jit* jit, uint16_t start) {
+  if(jit->code_used + BLOCK_CODE_SIZE > JIT_CODE_SIZE) {
+    jit_flush(jit);
+  }
+  size_t entry = jit->code_used;
+  if(protect_code(jit, entry, entry + BLOCK_CODE_SIZE, PROT_READ | PROT_WRITE) != SUCCESS) {
+    return NULL;
+  }
+  // The code is read through the bus, so put it back the way the interpreter
+  // expects it, with the opcode on the data bus
+  uint16_t saved_addr = *cpu->addr_bus;
+  uint8_t saved_data = *cpu->data_bus;
+
+  emit_prologue(jit);
+  uint16_t pc = start;
+  unsigned int count = 0;
+  int result = EMIT_CONTINUE;
+  while(result == EMIT_CONTINUE && count < JIT_MAX_BLOCK_INSTRUCTIONS) {
+    // Only code in memory that reports writes, otherwise we can't invalidate
+    if(!cpu->cacheable[pc >> 8] || !cpu->cacheable[(uint16_t)(pc + 2) >> 8]) {
+      break;
+    }
+    uint8_t opcode = read_bus(cpu, pc);
+    uint8_t length = instruction_length[opcodes[opcode]->addr_mode];
+    uint16_t operand = 0;
+    if(length > 1) {
+      operand = read_bus(cpu, pc + 1);
+    }
+    if(length > 2) {
+      operand |= read_bus(cpu, pc + 2) << 8;
+    }
+    size_t before = jit->code_used;
+    if(count) {
+      emit_boundary_check(jit, pc);
+    }
+    result = emit_instruction(jit, pc, opcode, operand);
+    if(result == EMIT_NONE) {
+      jit->code_used = before;
+      break;
+    }
+    ++count;
+    pc += length;
+  }
+
+  cpu->RW = true;
+  *cpu->addr_bus = saved_addr;
+  *cpu->data_bus = saved_data;
+
+  if(count && result != EMIT_END) {
+    emit_exit(jit, pc);
+  }
+  // Back to executable, along with the blocks before it in the same page
+  if(protect_code(jit, entry, entry + BLOCK_CODE_SIZE, PROT_READ | PROT_EXEC) != SUCCESS || !count) {
+    jit->code_used = entry;
+    return NULL;
+  }
+  jit_block block = (jit_block)(jit->code + entry);
+  jit->blocks[start] = block;
+  jit->block_length[start] = (uint16_t)(pc - start);
+  set_page_blocks(jit, start, 1);
+  return block;
+}
+
+int init_jit(M6502* cpu, uint16_t io_start, uint16_t io_end) {
+  pthread_once(&nz_flags_once, &init_nz_flags);
+  Jit* jit = calloc(1, sizeof(Jit));
+  if(jit == NULL) {
+    fprintf(stderr, "Unable to alloc JIT\n");
+    return ERROR_MEMORY_ALLOC;
+  }
+  jit->blocks = calloc(MEMSIZE, sizeof(jit_block));
+  jit->block_length = calloc(MEMSIZE, sizeof(uint8_t));
+  jit->heat = calloc(MEMSIZE, sizeof(uint8_t));
+  // Only made writable a block at a time, while translating it
+  jit->code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(jit->code == MAP_FAILED) {
+    jit->code = NULL;
+  }
+  if(jit->blocks == NULL || jit->block_length == NULL || jit->heat == NULL || jit->code == NULL) {
+    fprintf(stderr, "Unable to alloc JIT code buffers\n");
+    cpu->jit = jit;
+    destroy_jit(cpu);
+    return ERROR_MEMORY_ALLOC;
+  }
+  jit->io_start = io_start;
+  jit->io_end = io_end;
+  jit->enabled = true;
+  cpu->jit = jit;
+  return SUCCESS;
+}
+
+void destroy_jit(M6502* cpu) {
+  Jit* jit = cpu->jit;
+  if(jit == NULL) {
+    return;
+  }
+  if(jit->code != NULL) {
+    munmap(jit->code, JIT_CODE_SIZE);
+  }
+  free(jit->blocks);
+  free(jit->block_length);
+  free(jit->heat);
+  free(jit);
+  cpu->jit = NULL;
+}
+
+unsigned int run_translated(M6502* cpu) {
+  Jit* jit = cpu->jit;
+  if(!jit->enabled) {
+    return 0;
+  }
+  uint16_t pc = cpu->PC;
+  jit_block block = jit->blocks[pc];
+  if(block == NULL) {
+    // Whatever comes right after a block is likely hot as well
+    if(jit->after_block && jit->heat[pc] < JIT_HOT_THRESHOLD) {
+      jit->heat[pc]++;
+    }
+    jit->after_block = false;
+    if(jit->heat[pc] < JIT_HOT_THRESHOLD) {
+      return 0;
+    }
+    block = translate(cpu, jit, pc);
+    if(block == NULL) {
+      // Don't try again until it gets hot again
+      jit->heat[pc] = 0;
+      return 0;
+    }
+  }
+  if(cpu->break_enabled && (uint16_t)(cpu->break_addr - pc - 1) < jit->block_length[pc] - 1) {
+    // The block would run past the breakpoint
+    return 0;
+  }
+  // The first cycle of the instruction at PC has already been counted
+  unsigned long long now = cpu->tick_count - 1;
+  unsigned int limit = 0;
+  if(cpu->run_until > now) {
+    // The cycle count is kept in 16 bits, way more than a block can take
+    limit = (cpu->run_until - now > 0xFFFF) ? 0xFFFF : cpu->run_until - now;
+  }
+  jit->invalidated = false;
+  uint8_t opcode = *cpu->data_bus;
+  unsigned int ran = block(cpu, limit);
+  unsigned int cycles = ran % BLOCK_INSTRUCTION;
+  jit->after_block = cycles != 0;
+  if(cycles) {
+    // The first one was counted when it started
+    cpu->instructions += ran / BLOCK_INSTRUCTION - 1;
+  }
+  if(!cycles) {
+    // It might have read some indirect address before bailing out, and the
+    // interpreter expects the opcode on the data bus
+    cpu->RW = true;
+    *cpu->data_bus = opcode;
+  }
+  return cycles;
+}
+
+void jit_count_branch(Jit* jit, uint16_t target) {
+  if(jit->heat[target] < JIT_HOT_THRESHOLD) {
+    jit->heat[target]++;
+  }
+}
+
+void jit_invalidate(Jit* jit, uint16_t addr) {
+  if(!jit->page_blocks[addr >> 8]) {
+    return;
+  }
+  // Blocks are way shorter than a page, so only the ones starting in this page
+  // or the previous one can be overlapping the address
+  uint16_t first = (addr & 0xFF00) - PAGE_SIZE;
+  for(unsigned int i = 0; i < 2 * PAGE_SIZE; ++i) {
+    uint16_t start = first + i;
+    if(jit->blocks[start] != NULL && (uint16_t)(addr - start) < jit->block_length[start]) {
+      set_page_blocks(jit, start, -1);
+      jit->blocks[start] = NULL;
+      // Code that keeps getting modified has to get hot again, otherwise it'd
+      // be translated again every time
+      jit->heat[start] = 0;
+      jit->invalidated = true;
+    }
+  }
+}
+
+void jit_flush(Jit* jit) {
+  memset(jit->blocks, 0x00, MEMSIZE * sizeof(jit_block));
+  memset(jit->page_blocks, 0x00, sizeof(jit->page_blocks));
+  jit->code_used = 0;
+  jit->after_block = false;
+  jit->invalidated = true;
+}
+
+#else
+
+int init_jit(M6502* cpu, uint16_t io_start, uint16_t io_end) {
+  fprintf(stderr, "JIT not available in this build\n");
+  return FAILURE;
+}
+
+void destroy_jit(M6502* cpu) {
+}
+
+unsigned int run_translated(M6502* cpu) {
+  return 0;
+}
+
+void jit_count_branch(Jit* jit, uint16_t target) {
+}
+
+void jit_invalidate(Jit* jit, uint16_t addr) {
+}
+
+void jit_flush(Jit* jit) {
+}
+
+#endif
@@ -0,0 +1,73 @@
+/***************************************************************************
+ *   m6502_jit.h  --  This file is part of apple1emu.                      *
+ *                                                                         *
+ *   Copyright (C) 2021 Imanol-Mikel Barba Sabariego                       *
+ *                                                                         *
+ *   apple1emu is free software: you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published     *
+ *   by the Free Software Foundation, either version 3 of the License,     *
+ *   or (at your option) any later version.                                *
+ *                                                                         *
+ *   apple1emu is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty           *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.               *
+ *   See the GNU General Public License for more details.                  *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef M6502_JIT_H
+#define M6502_JIT_H
+
+#include "m6502.h"
+
+// Native code buffer. When it fills up, every block gets dropped at once
+#define JIT_CODE_SIZE 0x400000
+// Backward branches to an address before its block gets translated
+#define JIT_HOT_THRESHOLD 32
+#define JIT_MAX_BLOCK_INSTRUCTIONS 32
+
+// Translated basic block. Runs the guest instructions from PC and returns the
+// cycles they took, or 0 if it bailed out before completing the first one.
+// Doesn't start another instruction once it took limit cycles
+typedef unsigned int (*jit_block)(M6502* cpu, unsigned int limit);
+
+typedef struct Jit {
+  // Kill switch, everything goes through the interpreter while it's false
+  volatile bool enabled;
+
+  // Accesses within this range end the blocks and are left to the interpreter
+  uint16_t io_start;
+  uint16_t io_end;
+
+  uint8_t* code;
+  size_t code_used;
+
+  // Native entry point and guest length in bytes of the block starting at
+  // every address, and number of live blocks overlapping every page
+  jit_block* blocks;
+  uint8_t* block_length;
+  uint16_t page_blocks[NUM_PAGES];
+
+  // Hotness of every address, bumped on backward branches to it and when it's
+  // reached right after running a block
+  uint8_t* heat;
+  bool after_block;
+
+  // Set when a write drops some block, so that a running block stops right
+  // after that write in case it was modifying itself
+  volatile bool invalidated;
+} Jit;
+
+// Only available on x86-64 builds with APPLE1_JIT, returns FAILURE otherwise.
+// The blocks only run in the instruction-level engine
+int init_jit(M6502* cpu, uint16_t io_start, uint16_t io_end);
+void destroy_jit(M6502* cpu);
+unsigned int run_translated(M6502* cpu);
+void jit_count_branch(Jit* jit, uint16_t target);
+void jit_invalidate(Jit* jit, uint16_t addr);
+void jit_flush(Jit* jit);
+
+#endif
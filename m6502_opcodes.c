@@ -20,9 +20,16 @@
 
 #include "m6502.h"
 #include "m6502_opcodes.h"
+#include "m6502_instr.h"
+#include "m6502_profile.h"
 
 #include <stdio.h>
 
+// Dispatch strategy for run_opcode, chosen at build time
+#if !defined(DISPATCH_SWITCH) && !defined(DISPATCH_TABLE)
+#define DISPATCH_TABLE
+#endif
+
 // UNDEF
 void do_XX(M6502* cpu) {
   fprintf(stderr, "Unknown opcode: 0x%02X\n", cpu->IR >> 3);
@@ -70,7 +77,6 @@ void do_00(M6502* cpu) {
         cpu->AD = IRQ_VECTOR_ADDR;
       }
       cpu->break_status = 0;
-      *cpu->RES = true;
     break;
     case 4:
       *cpu->addr_bus = cpu->AD++;
@@ -85,6 +91,10 @@ void do_00(M6502* cpu) {
     break;
     case 6:
       cpu->PC = *cpu->data_bus << 8 | cpu->AD;
+      if(cpu->call_profile != NULL) {
+        // The high byte of the vector is still on the address bus
+        profile_interrupt(cpu->call_profile, *cpu->addr_bus == RESET_VECTOR_ADDR + 1, cpu->PC, cpu->S);
+      }
       fetch(cpu);
     break;
   }
@@ -325,6 +335,9 @@ void do_20(M6502* cpu) {
     break;
     case 5:
       cpu->PC = *cpu->data_bus << 8 | cpu->AD;
+      if(cpu->call_profile != NULL) {
+        profile_call(cpu->call_profile, cpu->PC, cpu->S);
+      }
       fetch(cpu);
     break;
   }
@@ -589,6 +602,9 @@ void do_40(M6502* cpu) {
     break;
     case 5:
       *cpu->PCH = *cpu->data_bus;
+      if(cpu->call_profile != NULL) {
+        profile_return(cpu->call_profile, cpu->S);
+      }
       fetch(cpu);
     break;
   }
@@ -843,6 +859,9 @@ void do_60(M6502* cpu) {
     case 4:
       cpu->PC = cpu->AD | ((*cpu->data_bus) << 8);
       *cpu->addr_bus = cpu->PC++;
+      if(cpu->call_profile != NULL) {
+        profile_return(cpu->call_profile, cpu->S);
+      }
     break;
     case 5:
       fetch(cpu);
@@ -2144,461 +2163,613 @@ void do_FE(M6502* cpu) {
 }
 
 Opcode op_XX = {
-  .name = "UNK", .op = &do_XX, .write = false, .addr_mode = ADDR_IMPLICIT
+  .name = "UNK", .op = &do_XX, .write = false, .addr_mode = ADDR_IMPLICIT,
+  .instr = &instr_XX, .cycles = 2
 };
 Opcode op_00 = {
   // Not really immediate addressing, but has the break mark, so...
-  .name = "BRK", .op = &do_00, .write = false, .addr_mode = ADDR_IMMEDIATE 
+  .name = "BRK", .op = &do_00, .write = false, .addr_mode = ADDR_IMMEDIATE,
+  .instr = &instr_BRK, .cycles = 7
 };
 Opcode op_01 = {
-  .name = "ORA", .op = &do_01, .write = false, .addr_mode = ADDR_INDEX_IND
+  .name = "ORA", .op = &do_01, .write = false, .addr_mode = ADDR_INDEX_IND,
+  .instr = &instr_ORA, .cycles = 6
 };
 Opcode op_05 = {
-  .name = "ORA", .op = &do_05, .write = false, .addr_mode = ADDR_ZPG
+  .name = "ORA", .op = &do_05, .write = false, .addr_mode = ADDR_ZPG,
+  .instr = &instr_ORA, .cycles = 3
 };
 Opcode op_06 = {
-  .name = "ASL", .op = &do_06, .write = true, .addr_mode = ADDR_ZPG
+  .name = "ASL", .op = &do_06, .write = true, .addr_mode = ADDR_ZPG,
+  .instr = &instr_ASL, .cycles = 5
 };
 Opcode op_08 = {
-  .name = "PHP", .op = &do_08, .write = false, .addr_mode = ADDR_IMPLICIT
+  .name = "PHP", .op = &do_08, .write = false, .addr_mode = ADDR_IMPLICIT,
+  .instr = &instr_PHP, .cycles = 3
 };
 Opcode op_09 = {
-  .name = "ORA", .op = &do_09, .write = false, .addr_mode = ADDR_IMMEDIATE
+  .name = "ORA", .op = &do_09, .write = false, .addr_mode = ADDR_IMMEDIATE,
+  .instr = &instr_ORA, .cycles = 2
 };
 Opcode op_0A = {
-  .name = "ASL", .op = &do_0A, .write = true, .addr_mode = ADDR_ACCUMULATOR
+  .name = "ASL", .op = &do_0A, .write = true, .addr_mode = ADDR_ACCUMULATOR,
+  .instr = &instr_ASL_A, .cycles = 2
 };
 Opcode op_0D = {
-  .name = "ORA", .op = &do_0D, .write = false, .addr_mode = ADDR_ABSOLUTE
+  .name = "ORA", .op = &do_0D, .write = false, .addr_mode = ADDR_ABSOLUTE,
+  .instr = &instr_ORA, .cycles = 4
 };
 Opcode op_0E = {
-  .name = "ASL", .op = &do_0E, .write = true, .addr_mode = ADDR_ABSOLUTE 
+  .name = "ASL", .op = &do_0E, .write = true, .addr_mode = ADDR_ABSOLUTE,
+  .instr = &instr_ASL, .cycles = 6
 };
 Opcode op_10 = {
-  .name = "BPL", .op = &do_10, .write = false, .addr_mode = ADDR_RELATIVE
+  .name = "BPL", .op = &do_10, .write = false, .addr_mode = ADDR_RELATIVE,
+  .instr = &instr_BPL, .cycles = 2
 };
 Opcode op_11 = {
-  .name = "ORA", .op = &do_11, .write = false, .addr_mode = ADDR_IND_INDEX
+  .name = "ORA", .op = &do_11, .write = false, .addr_mode = ADDR_IND_INDEX,
+  .instr = &instr_ORA, .cycles = 5
 };
 Opcode op_15 = {
-  .name = "ORA", .op = &do_15, .write = false, .addr_mode = ADDR_ZPG_X
+  .name = "ORA", .op = &do_15, .write = false, .addr_mode = ADDR_ZPG_X,
+  .instr = &instr_ORA, .cycles = 4
 };
 Opcode op_16 = {
-  .name = "ASL", .op = &do_16, .write = true, .addr_mode = ADDR_ZPG_X
+  .name = "ASL", .op = &do_16, .write = true, .addr_mode = ADDR_ZPG_X,
+  .instr = &instr_ASL, .cycles = 6
 };
 Opcode op_18 = {
-  .name = "CLC", .op = &do_18, .write = false, .addr_mode = ADDR_IMPLICIT
+  .name = "CLC", .op = &do_18, .write = false, .addr_mode = ADDR_IMPLICIT,
+  .instr = &instr_CLC, .cycles = 2
 };
 Opcode op_19 = {
-  .name = "ORA", .op = &do_19, .write = false, .addr_mode = ADDR_ABSOLUTE_Y
+  .name = "ORA", .op = &do_19, .write = false, .addr_mode = ADDR_ABSOLUTE_Y,
+  .instr = &instr_ORA, .cycles = 4
 };
 Opcode op_1D = {
-  .name = "ORA", .op = &do_1D, .write = false, .addr_mode = ADDR_ABSOLUTE_X
+  .name = "ORA", .op = &do_1D, .write = false, .addr_mode = ADDR_ABSOLUTE_X,
+  .instr = &instr_ORA, .cycles = 4
 };
 Opcode op_1E = {
-  .name = "ASL", .op = &do_1E, .write = true, .addr_mode = ADDR_ABSOLUTE_X
+  .name = "ASL", .op = &do_1E, .write = true, .addr_mode = ADDR_ABSOLUTE_X,
+  .instr = &instr_ASL, .cycles = 7
 };
 Opcode op_20 = {
-  .name = "JSR", .op = &do_20, .write = false, .addr_mode = ADDR_ABSOLUTE
+  .name = "JSR", .op = &do_20, .write = false, .addr_mode = ADDR_ABSOLUTE,
+  .instr = &instr_JSR, .cycles = 6
 };
 Opcode op_21 = {
-  .name = "AND", .op = &do_21, .write = false, .addr_mode = ADDR_INDEX_IND
+  .name = "AND", .op = &do_21, .write = false, .addr_mode = ADDR_INDEX_IND,
+  .instr = &instr_AND, .cycles = 6
 };
 Opcode op_24 = {
-  .name = "BIT", .op = &do_24, .write = false, .addr_mode = ADDR_ZPG
+  .name = "BIT", .op = &do_24, .write = false, .addr_mode = ADDR_ZPG,
+  .instr = &instr_BIT, .cycles = 3
 };
 Opcode op_25 = {
-  .name = "AND", .op = &do_25, .write = false, .addr_mode = ADDR_ZPG
+  .name = "AND", .op = &do_25, .write = false, .addr_mode = ADDR_ZPG,
+  .instr = &instr_AND, .cycles = 3
 };
 Opcode op_26 = {
-  .name = "ROL", .op = &do_26, .write = true, .addr_mode = ADDR_ZPG
+  .name = "ROL", .op = &do_26, .write = true, .addr_mode = ADDR_ZPG,
+  .instr = &instr_ROL, .cycles = 5
 };
 Opcode op_28 = {
-  .name = "PLP", .op = &do_28, .write = false, .addr_mode = ADDR_IMPLICIT
+  .name = "PLP", .op = &do_28, .write = false, .addr_mode = ADDR_IMPLICIT,
+  .instr = &instr_PLP, .cycles = 4
 };
 Opcode op_29 = {
-  .name = "AND", .op = &do_29, .write = false, .addr_mode = ADDR_IMMEDIATE
+  .name = "AND", .op = &do_29, .write = false, .addr_mode = ADDR_IMMEDIATE,
+  .instr = &instr_AND, .cycles = 2
 };
 Opcode op_2A = {
-  .name = "ROL", .op = &do_2A, .write = true, .addr_mode = ADDR_ACCUMULATOR
+  .name = "ROL", .op = &do_2A, .write = true, .addr_mode = ADDR_ACCUMULATOR,
+  .instr = &instr_ROL_A, .cycles = 2
 };
 Opcode op_2C = {
-  .name = "BIT", .op = &do_2C, .write = false, .addr_mode = ADDR_ABSOLUTE
+  .name = "BIT", .op = &do_2C, .write = false, .addr_mode = ADDR_ABSOLUTE,
+  .instr = &instr_BIT, .cycles = 4
 };
 Opcode op_2D = {
-  .name = "AND", .op = &do_2D, .write = false, .addr_mode = ADDR_ABSOLUTE
+  .name = "AND", .op = &do_2D, .write = false, .addr_mode = ADDR_ABSOLUTE,
+  .instr = &instr_AND, .cycles = 4
 };
 Opcode op_2E = {
-  .name = "ROL", .op = &do_2E, .write = true, .addr_mode = ADDR_ABSOLUTE
+  .name = "ROL", .op = &do_2E, .write = true, .addr_mode = ADDR_ABSOLUTE,
+  .instr = &instr_ROL, .cycles = 6
 };
 Opcode op_30 = {
-  .name = "BMI", .op = &do_30, .write = false, .addr_mode = ADDR_RELATIVE
+  .name = "BMI", .op = &do_30, .write = false, .addr_mode = ADDR_RELATIVE,
+  .instr = &instr_BMI, .cycles = 2
 };
 Opcode op_31 = {
-  .name = "AND", .op = &do_31, .write = false, .addr_mode = ADDR_IND_INDEX
+  .name = "AND", .op = &do_31, .write = false, .addr_mode = ADDR_IND_INDEX,
+  .instr = &instr_AND, .cycles = 5
 };
 Opcode op_35 = {
-  .name = "AND", .op = &do_35, .write = false, .addr_mode = ADDR_ZPG_X
+  .name = "AND", .op = &do_35, .write = false, .addr_mode = ADDR_ZPG_X,
+  .instr = &instr_AND, .cycles = 4
 };
 Opcode op_36 = {
-  .name = "ROL", .op = &do_36, .write = true, .addr_mode = ADDR_ZPG_X
+  .name = "ROL", .op = &do_36, .write = true, .addr_mode = ADDR_ZPG_X,
+  .instr = &instr_ROL, .cycles = 6
 };
 Opcode op_38 = {
-  .name = "SEC", .op = &do_38, .write = false, .addr_mode = ADDR_IMPLICIT
+  .name = "SEC", .op = &do_38, .write = false, .addr_mode = ADDR_IMPLICIT,
+  .instr = &instr_SEC, .cycles = 2
 };
 Opcode op_39 = {
-  .name = "AND", .op = &do_39, .write = false, .addr_mode = ADDR_ABSOLUTE_Y
+  .name = "AND", .op = &do_39, .write = false, .addr_mode = ADDR_ABSOLUTE_Y,
+  .instr = &instr_AND, .cycles = 4
 };
 Opcode op_3D = {
-  .name = "AND", .op = &do_3D, .write = false, .addr_mode = ADDR_ABSOLUTE_X
+  .name = "AND", .op = &do_3D, .write = false, .addr_mode = ADDR_ABSOLUTE_X,
+  .instr = &instr_AND, .cycles = 4
 };
 Opcode op_3E = {
-  .name = "ROL", .op = &do_3E, .write = true, .addr_mode = ADDR_ABSOLUTE_X
+  .name = "ROL", .op = &do_3E, .write = true, .addr_mode = ADDR_ABSOLUTE_X,
+  .instr = &instr_ROL, .cycles = 7
 };
 Opcode op_40 = {
-  .name = "RTI", .op = &do_40, .write = false, .addr_mode = ADDR_IMPLICIT
+  .name = "RTI", .op = &do_40, .write = false, .addr_mode = ADDR_IMPLICIT,
+  .instr = &instr_RTI, .cycles = 6
 };
 Opcode op_41 = {
-  .name = "EOR", .op = &do_41, .write = false, .addr_mode = ADDR_INDEX_IND
+  .name = "EOR", .op = &do_41, .write = false, .addr_mode = ADDR_INDEX_IND,
+  .instr = &instr_EOR, .cycles = 6
 };
 Opcode op_45 = {
-  .name = "EOR", .op = &do_45, .write = false, .addr_mode = ADDR_ZPG
+  .name = "EOR", .op = &do_45, .write = false, .addr_mode = ADDR_ZPG,
+  .instr = &instr_EOR, .cycles = 3
 };
 Opcode op_46 = {
-  .name = "LSR", .op = &do_46, .write = true, .addr_mode = ADDR_ZPG
+  .name = "LSR", .op = &do_46, .write = true, .addr_mode = ADDR_ZPG,
+  .instr = &instr_LSR, .cycles = 5
 };
 Opcode op_48 = {
-  .name = "PHA", .op = &do_48, .write = false, .addr_mode = ADDR_IMPLICIT
+  .name = "PHA", .op = &do_48, .write = false, .addr_mode = ADDR_IMPLICIT,
+  .instr = &instr_PHA, .cycles = 3
 };
 Opcode op_49 = {
-  .name = "EOR", .op = &do_49, .write = false, .addr_mode = ADDR_IMMEDIATE
+  .name = "EOR", .op = &do_49, .write = false, .addr_mode = ADDR_IMMEDIATE,
+  .instr = &instr_EOR, .cycles = 2
 };
 Opcode op_4A = {
-  .name = "LSR", .op = &do_4A, .write = true, .addr_mode = ADDR_ACCUMULATOR
+  .name = "LSR", .op = &do_4A, .write = true, .addr_mode = ADDR_ACCUMULATOR,
+  .instr = &instr_LSR_A, .cycles = 2
 };
 Opcode op_4C = {
-  .name = "JMP", .op = &do_4C, .write = false, .addr_mode = ADDR_ABSOLUTE
+  .name = "JMP", .op = &do_4C, .write = false, .addr_mode = ADDR_ABSOLUTE,
+  .instr = &instr_JMP, .cycles = 3
 };
 Opcode op_4D = {
-  .name = "EOR", .op = &do_4D, .write = false, .addr_mode = ADDR_ABSOLUTE
+  .name = "EOR", .op = &do_4D, .write = false, .addr_mode = ADDR_ABSOLUTE,
+  .instr = &instr_EOR, .cycles = 4
 };
 Opcode op_4E = {
-  .name = "LSR", .op = &do_4E, .write = true, .addr_mode = ADDR_ABSOLUTE
+  .name = "LSR", .op = &do_4E, .write = true, .addr_mode = ADDR_ABSOLUTE,
+  .instr = &instr_LSR, .cycles = 6
 };
 Opcode op_50 = {
-  .name = "BVC", .op = &do_50, .write = false, .addr_mode = ADDR_RELATIVE
+  .name = "BVC", .op = &do_50, .write = false, .addr_mode = ADDR_RELATIVE,
+  .instr = &instr_BVC, .cycles = 2
 };
 Opcode op_51 = {
-  .name = "EOR", .op = &do_51, .write = false, .addr_mode = ADDR_IND_INDEX
+  .name = "EOR", .op = &do_51, .write = false, .addr_mode = ADDR_IND_INDEX,
+  .instr = &instr_EOR, .cycles = 5
 };
 Opcode op_55 = {
-  .name = "EOR", .op = &do_55, .write = false, .addr_mode = ADDR_ZPG_X
+  .name = "EOR", .op = &do_55, .write = false, .addr_mode = ADDR_ZPG_X,
+  .instr = &instr_EOR, .cycles = 4
 };
 Opcode op_56 = {
-  .name = "LSR", .op = &do_56, .write = true, .addr_mode = ADDR_ZPG_X
+  .name = "LSR", .op = &do_56, .write = true, .addr_mode = ADDR_ZPG_X,
+  .instr = &instr_LSR, .cycles = 6
 };
 Opcode op_58 = {
-  .name = "CLI", .op = &do_58, .write = false, .addr_mode = ADDR_IMPLICIT
+  .name = "CLI", .op = &do_58, .write = false, .addr_mode = ADDR_IMPLICIT,
+  .instr = &instr_CLI, .cycles = 2
 };
 Opcode op_59 = {
-  .name = "EOR", .op = &do_59, .write = false, .addr_mode = ADDR_ABSOLUTE_Y
+  .name = "EOR", .op = &do_59, .write = false, .addr_mode = ADDR_ABSOLUTE_Y,
+  .instr = &instr_EOR, .cycles = 4
 };
 Opcode op_5D = {
-  .name = "EOR", .op = &do_5D, .write = false, .addr_mode = ADDR_ABSOLUTE_X
+  .name = "EOR", .op = &do_5D, .write = false, .addr_mode = ADDR_ABSOLUTE_X,
+  .instr = &instr_EOR, .cycles = 4
 };
 Opcode op_5E = {
-  .name = "LSR", .op = &do_5E, .write = true, .addr_mode = ADDR_ABSOLUTE_X
+  .name = "LSR", .op = &do_5E, .write = true, .addr_mode = ADDR_ABSOLUTE_X,
+  .instr = &instr_LSR, .cycles = 7
 };
 Opcode op_60 = {
-  .name = "RTS", .op = &do_60, .write = false, .addr_mode = ADDR_IMPLICIT
+  .name = "RTS", .op = &do_60, .write = false, .addr_mode = ADDR_IMPLICIT,
+  .instr = &instr_RTS, .cycles = 6
 };
 Opcode op_61 = {
-  .name = "ADC", .op = &do_61, .write = false, .addr_mode = ADDR_INDEX_IND
+  .name = "ADC", .op = &do_61, .write = false, .addr_mode = ADDR_INDEX_IND,
+  .instr = &instr_ADC, .cycles = 6
 };
 Opcode op_65 = {
-  .name = "ADC", .op = &do_65, .write = false, .addr_mode = ADDR_ZPG
+  .name = "ADC", .op = &do_65, .write = false, .addr_mode = ADDR_ZPG,
+  .instr = &instr_ADC, .cycles = 3
 };
 Opcode op_66 = {
-  .name = "ROR", .op = &do_66, .write = true, .addr_mode = ADDR_ZPG
+  .name = "ROR", .op = &do_66, .write = true, .addr_mode = ADDR_ZPG,
+  .instr = &instr_ROR, .cycles = 5
 };
 Opcode op_68 = {
-  .name = "PLA", .op = &do_68, .write = false, .addr_mode = ADDR_IMPLICIT
+  .name = "PLA", .op = &do_68, .write = false, .addr_mode = ADDR_IMPLICIT,
+  .instr = &instr_PLA, .cycles = 4
 };
 Opcode op_69 = {
-  .name = "ADC", .op = &do_69, .write = false, .addr_mode = ADDR_IMMEDIATE
+  .name = "ADC", .op = &do_69, .write = false, .addr_mode = ADDR_IMMEDIATE,
+  .instr = &instr_ADC, .cycles = 2
 };
 Opcode op_6A = {
-  .name = "ROR", .op = &do_6A, .write = true, .addr_mode = ADDR_ACCUMULATOR
+  .name = "ROR", .op = &do_6A, .write = true, .addr_mode = ADDR_ACCUMULATOR,
+  .instr = &instr_ROR_A, .cycles = 2
 };
 Opcode op_6C = {
-  .name = "JMP", .op = &do_6C, .write = false, .addr_mode = ADDR_INDIRECT
+  .name = "JMP", .op = &do_6C, .write = false, .addr_mode = ADDR_INDIRECT,
+  .instr = &instr_JMP, .cycles = 5
 };
 Opcode op_6D = {
-  .name = "ADC", .op = &do_6D, .write = false, .addr_mode = ADDR_ABSOLUTE
+  .name = "ADC", .op = &do_6D, .write = false, .addr_mode = ADDR_ABSOLUTE,
+  .instr = &instr_ADC, .cycles = 4
 };
 Opcode op_6E = {
-  .name = "ROR", .op = &do_6E, .write = true, .addr_mode = ADDR_ABSOLUTE
+  .name = "ROR", .op = &do_6E, .write = true, .addr_mode = ADDR_ABSOLUTE,
+  .instr = &instr_ROR, .cycles = 6
 };
 Opcode op_70 = {
-  .name = "BVS", .op = &do_70, .write = false, .addr_mode = ADDR_RELATIVE
+  .name = "BVS", .op = &do_70, .write = false, .addr_mode = ADDR_RELATIVE,
+  .instr = &instr_BVS, .cycles = 2
 };
 Opcode op_71 = {
-  .name = "ADC", .op = &do_71, .write = false, .addr_mode = ADDR_IND_INDEX
+  .name = "ADC", .op = &do_71, .write = false, .addr_mode = ADDR_IND_INDEX,
+  .instr = &instr_ADC, .cycles = 5
 };
 Opcode op_75 = {
-  .name = "ADC", .op = &do_75, .write = false, .addr_mode = ADDR_ZPG_X
+  .name = "ADC", .op = &do_75, .write = false, .addr_mode = ADDR_ZPG_X,
+  .instr = &instr_ADC, .cycles = 4
 };
 Opcode op_76 = {
-  .name = "ROR", .op = &do_76, .write = true, .addr_mode = ADDR_ZPG_X
+  .name = "ROR", .op = &do_76, .write = true, .addr_mode = ADDR_ZPG_X,
+  .instr = &instr_ROR, .cycles = 6
 };
 Opcode op_78 = {
-  .name = "SEI", .op = &do_78, .write = false, .addr_mode = ADDR_IMPLICIT
+  .name = "SEI", .op = &do_78, .write = false, .addr_mode = ADDR_IMPLICIT,
+  .instr = &instr_SEI, .cycles = 2
 };
 Opcode op_79 = {
-  .name = "ADC", .op = &do_79, .write = false, .addr_mode = ADDR_ABSOLUTE_Y
+  .name = "ADC", .op = &do_79, .write = false, .addr_mode = ADDR_ABSOLUTE_Y,
+  .instr = &instr_ADC, .cycles = 4
 };
 Opcode op_7D = {
-  .name = "ADC", .op = &do_7D, .write = false, .addr_mode = ADDR_ABSOLUTE_X
+  .name = "ADC", .op = &do_7D, .write = false, .addr_mode = ADDR_ABSOLUTE_X,
+  .instr = &instr_ADC, .cycles = 4
 };
 Opcode op_7E = {
-  .name = "ROR", .op = &do_7E, .write = true, .addr_mode = ADDR_ABSOLUTE_X
+  .name = "ROR", .op = &do_7E, .write = true, .addr_mode = ADDR_ABSOLUTE_X,
+  .instr = &instr_ROR, .cycles = 7
 };
 Opcode op_81 = {
-  .name = "STA", .op = &do_81, .write = true, .addr_mode = ADDR_INDEX_IND
+  .name = "STA", .op = &do_81, .write = true, .addr_mode = ADDR_INDEX_IND,
+  .instr = &instr_STA, .cycles = 6
 };
 Opcode op_84 = {
-  .name = "STY", .op = &do_84, .write = false, .addr_mode = ADDR_ZPG
+  .name = "STY", .op = &do_84, .write = false, .addr_mode = ADDR_ZPG,
+  .instr = &instr_STY, .cycles = 3
 };
 Opcode op_85 = {
-  .name = "STA", .op = &do_85, .write = true, .addr_mode = ADDR_ZPG
+  .name = "STA", .op = &do_85, .write = true, .addr_mode = ADDR_ZPG,
+  .instr = &instr_STA, .cycles = 3
 };
 Opcode op_86 = {
-  .name = "STX", .op = &do_86, .write = false, .addr_mode = ADDR_ZPG
+  .name = "STX", .op = &do_86, .write = false, .addr_mode = ADDR_ZPG,
+  .instr = &instr_STX, .cycles = 3
 };
 Opcode op_88 = {
-  .name = "DEY", .op = &do_88, .write = false, .addr_mode = ADDR_IMPLICIT
+  .name = "DEY", .op = &do_88, .write = false, .addr_mode = ADDR_IMPLICIT,
+  .instr = &instr_DEY, .cycles = 2
 };
 Opcode op_8A = {
-  .name = "TXA", .op = &do_8A, .write = false, .addr_mode = ADDR_IMPLICIT
+  .name = "TXA", .op = &do_8A, .write = false, .addr_mode = ADDR_IMPLICIT,
+  .instr = &instr_TXA, .cycles = 2
 };
 Opcode op_8C = {
-  .name = "STY", .op = &do_8C, .write = false, .addr_mode = ADDR_ABSOLUTE
+  .name = "STY", .op = &do_8C, .write = false, .addr_mode = ADDR_ABSOLUTE,
+  .instr = &instr_STY, .cycles = 4
 };
 Opcode op_8D = {
-  .name = "STA", .op = &do_8D, .write = true, .addr_mode = ADDR_ABSOLUTE
+  .name = "STA", .op = &do_8D, .write = true, .addr_mode = ADDR_ABSOLUTE,
+  .instr = &instr_STA, .cycles = 4
 };
 Opcode op_8E = {
-  .name = "STX", .op = &do_8E, .write = false, .addr_mode = ADDR_ABSOLUTE
+  .name = "STX", .op = &do_8E, .write = false, .addr_mode = ADDR_ABSOLUTE,
+  .instr = &instr_STX, .cycles = 4
 };
 Opcode op_90 = {
-  .name = "BCC", .op = &do_90, .write = false, .addr_mode = ADDR_RELATIVE
+  .name = "BCC", .op = &do_90, .write = false, .addr_mode = ADDR_RELATIVE,
+  .instr = &instr_BCC, .cycles = 2
 };
 Opcode op_91 = {
-  .name = "STA", .op = &do_91, .write = true, .addr_mode = ADDR_IND_INDEX
+  .name = "STA", .op = &do_91, .write = true, .addr_mode = ADDR_IND_INDEX,
+  .instr = &instr_STA, .cycles = 6
 };
 Opcode op_94 = {
-  .name = "STY", .op = &do_94, .write = false, .addr_mode = ADDR_ZPG_X
+  .name = "STY", .op = &do_94, .write = false, .addr_mode = ADDR_ZPG_X,
+  .instr = &instr_STY, .cycles = 4
 };
 Opcode op_95 = {
-  .name = "STA", .op = &do_95, .write = true, .addr_mode = ADDR_ZPG_X
+  .name = "STA", .op = &do_95, .write = true, .addr_mode = ADDR_ZPG_X,
+  .instr = &instr_STA, .cycles = 4
 };
 Opcode op_96 = {
-  .name = "STX", .op = &do_96, .write = false, .addr_mode = ADDR_ZPG_Y
+  .name = "STX", .op = &do_96, .write = false, .addr_mode = ADDR_ZPG_Y,
+  .instr = &instr_STX, .cycles = 4
 };
 Opcode op_98 = {
-  .name = "TYA", .op = &do_98, .write = false, .addr_mode = ADDR_IMPLICIT
+  .name = "TYA", .op = &do_98, .write = false, .addr_mode = ADDR_IMPLICIT,
+  .instr = &instr_TYA, .cycles = 2
 };
 Opcode op_99 = {
-  .name = "STA", .op = &do_99, .write = true, .addr_mode = ADDR_ABSOLUTE_Y
+  .name = "STA", .op = &do_99, .write = true, .addr_mode = ADDR_ABSOLUTE_Y,
+  .instr = &instr_STA, .cycles = 5
 };
 Opcode op_9A = {
-  .name = "TXS", .op = &do_9A, .write = false, .addr_mode = ADDR_IMPLICIT
+  .name = "TXS", .op = &do_9A, .write = false, .addr_mode = ADDR_IMPLICIT,
+  .instr = &instr_TXS, .cycles = 2
 };
 Opcode op_9D = {
-  .name = "STA", .op = &do_9D, .write = true, .addr_mode = ADDR_ABSOLUTE_X
+  .name = "STA", .op = &do_9D, .write = true, .addr_mode = ADDR_ABSOLUTE_X,
+  .instr = &instr_STA, .cycles = 5
 };
 Opcode op_A0 = {
-  .name = "LDY", .op = &do_A0, .write = false, .addr_mode = ADDR_IMMEDIATE
+  .name = "LDY", .op = &do_A0, .write = false, .addr_mode = ADDR_IMMEDIATE,
+  .instr = &instr_LDY, .cycles = 2
 };
 Opcode op_A1 = {
-  .name = "LDA", .op = &do_A1, .write = false, .addr_mode = ADDR_INDEX_IND
+  .name = "LDA", .op = &do_A1, .write = false, .addr_mode = ADDR_INDEX_IND,
+  .instr = &instr_LDA, .cycles = 6
 };
 Opcode op_A2 = {
-  .name = "LDX", .op = &do_A2, .write = false, .addr_mode = ADDR_IMMEDIATE
+  .name = "LDX", .op = &do_A2, .write = false, .addr_mode = ADDR_IMMEDIATE,
+  .instr = &instr_LDX, .cycles = 2
 };
 Opcode op_A4 = {
-  .name = "LDY", .op = &do_A4, .write = false, .addr_mode = ADDR_ZPG
+  .name = "LDY", .op = &do_A4, .write = false, .addr_mode = ADDR_ZPG,
+  .instr = &instr_LDY, .cycles = 3
 };
 Opcode op_A5 = {
-  .name = "LDA", .op = &do_A5, .write = false, .addr_mode = ADDR_ZPG
+  .name = "LDA", .op = &do_A5, .write = false, .addr_mode = ADDR_ZPG,
+  .instr = &instr_LDA, .cycles = 3
 };
 Opcode op_A6 = {
-  .name = "LDX", .op = &do_A6, .write = false, .addr_mode = ADDR_ZPG
+  .name = "LDX", .op = &do_A6, .write = false, .addr_mode = ADDR_ZPG,
+  .instr = &instr_LDX, .cycles = 3
 };
 Opcode op_A8 = {
-  .name = "TAY", .op = &do_A8, .write = false, .addr_mode = ADDR_IMPLICIT
+  .name = "TAY", .op = &do_A8, .write = false, .addr_mode = ADDR_IMPLICIT,
+  .instr = &instr_TAY, .cycles = 2
 };
 Opcode op_A9 = {
-  .name = "LDA", .op = &do_A9, .write = false, .addr_mode = ADDR_IMMEDIATE
+  .name = "LDA", .op = &do_A9, .write = false, .addr_mode = ADDR_IMMEDIATE,
+  .instr = &instr_LDA, .cycles = 2
 };
 Opcode op_AA = {
-  .name = "TAX", .op = &do_AA, .write = false, .addr_mode = ADDR_IMPLICIT
+  .name = "TAX", .op = &do_AA, .write = false, .addr_mode = ADDR_IMPLICIT,
+  .instr = &instr_TAX, .cycles = 2
 };
 Opcode op_AC = {
-  .name = "LDY", .op = &do_AC, .write = false, .addr_mode = ADDR_ABSOLUTE
+  .name = "LDY", .op = &do_AC, .write = false, .addr_mode = ADDR_ABSOLUTE,
+  .instr = &instr_LDY, .cycles = 4
 };
 Opcode op_AD = {
-  .name = "LDA", .op = &do_AD, .write = false, .addr_mode = ADDR_ABSOLUTE
+  .name = "LDA", .op = &do_AD, .write = false, .addr_mode = ADDR_ABSOLUTE,
+  .instr = &instr_LDA, .cycles = 4
 };
 Opcode op_AE = {
-  .name = "LDX", .op = &do_AE, .write = false, .addr_mode = ADDR_ABSOLUTE
+  .name = "LDX", .op = &do_AE, .write = false, .addr_mode = ADDR_ABSOLUTE,
+  .instr = &instr_LDX, .cycles = 4
 };
 Opcode op_B0 = {
-  .name = "BCS", .op = &do_B0, .write = false, .addr_mode = ADDR_RELATIVE
+  .name = "BCS", .op = &do_B0, .write = false, .addr_mode = ADDR_RELATIVE,
+  .instr = &instr_BCS, .cycles = 2
 };
 Opcode op_B1 = {
-  .name = "LDA", .op = &do_B1, .write = false, .addr_mode = ADDR_IND_INDEX
+  .name = "LDA", .op = &do_B1, .write = false, .addr_mode = ADDR_IND_INDEX,
+  .instr = &instr_LDA, .cycles = 5
 };
 Opcode op_B4 = {
-  .name = "LDY", .op = &do_B4, .write = false, .addr_mode = ADDR_ZPG_X
+  .name = "LDY", .op = &do_B4, .write = false, .addr_mode = ADDR_ZPG_X,
+  .instr = &instr_LDY, .cycles = 4
 };
 Opcode op_B5 = {
-  .name = "LDA", .op = &do_B5, .write = false, .addr_mode = ADDR_ZPG_X
+  .name = "LDA", .op = &do_B5, .write = false, .addr_mode = ADDR_ZPG_X,
+  .instr = &instr_LDA, .cycles = 4
 };
 Opcode op_B6 = {
-  .name = "LDX", .op = &do_B6, .write = false, .addr_mode = ADDR_ZPG_Y
+  .name = "LDX", .op = &do_B6, .write = false, .addr_mode = ADDR_ZPG_Y,
+  .instr = &instr_LDX, .cycles = 4
 };
 Opcode op_B8 = {
-  .name = "CLV", .op = &do_B8, .write = false, .addr_mode = ADDR_IMPLICIT
+  .name = "CLV", .op = &do_B8, .write = false, .addr_mode = ADDR_IMPLICIT,
+  .instr = &instr_CLV, .cycles = 2
 };
 Opcode op_B9 = {
-  .name = "LDA", .op = &do_B9, .write = false, .addr_mode = ADDR_ABSOLUTE_Y
+  .name = "LDA", .op = &do_B9, .write = false, .addr_mode = ADDR_ABSOLUTE_Y,
+  .instr = &instr_LDA, .cycles = 4
 };
 Opcode op_BA = {
-  .name = "TSX", .op = &do_BA, .write = false, .addr_mode = ADDR_IMPLICIT
+  .name = "TSX", .op = &do_BA, .write = false, .addr_mode = ADDR_IMPLICIT,
+  .instr = &instr_TSX, .cycles = 2
 };
 Opcode op_BC = {
-  .name = "LDY", .op = &do_BC, .write = false, .addr_mode = ADDR_ABSOLUTE_X
+  .name = "LDY", .op = &do_BC, .write = false, .addr_mode = ADDR_ABSOLUTE_X,
+  .instr = &instr_LDY, .cycles = 4
 };
 Opcode op_BD = {
-  .name = "LDA", .op = &do_BD, .write = false, .addr_mode = ADDR_ABSOLUTE_X
+  .name = "LDA", .op = &do_BD, .write = false, .addr_mode = ADDR_ABSOLUTE_X,
+  .instr = &instr_LDA, .cycles = 4
 };
 Opcode op_BE = {
-  .name = "LDX", .op = &do_BE, .write = false, .addr_mode = ADDR_ABSOLUTE_Y
+  .name = "LDX", .op = &do_BE, .write = false, .addr_mode = ADDR_ABSOLUTE_Y,
+  .instr = &instr_LDX, .cycles = 4
 };
 Opcode op_C0 = {
-  .name = "CPY", .op = &do_C0, .write = false, .addr_mode = ADDR_IMMEDIATE
+  .name = "CPY", .op = &do_C0, .write = false, .addr_mode = ADDR_IMMEDIATE,
+  .instr = &instr_CPY, .cycles = 2
 };
 Opcode op_C1 = {
-  .name = "CMP", .op = &do_C1, .write = false, .addr_mode = ADDR_INDEX_IND
+  .name = "CMP", .op = &do_C1, .write = false, .addr_mode = ADDR_INDEX_IND,
+  .instr = &instr_CMP, .cycles = 6
 };
 Opcode op_C4 = {
-  .name = "CPY", .op = &do_C4, .write = false, .addr_mode = ADDR_ZPG
+  .name = "CPY", .op = &do_C4, .write = false, .addr_mode = ADDR_ZPG,
+  .instr = &instr_CPY, .cycles = 3
 };
 Opcode op_C5 = {
-  .name = "CMP", .op = &do_C5, .write = false, .addr_mode = ADDR_ZPG
+  .name = "CMP", .op = &do_C5, .write = false, .addr_mode = ADDR_ZPG,
+  .instr = &instr_CMP, .cycles = 3
 };
 Opcode op_C6 = {
-  .name = "DEC", .op = &do_C6, .write = true, .addr_mode = ADDR_ZPG
+  .name = "DEC", .op = &do_C6, .write = true, .addr_mode = ADDR_ZPG,
+  .instr = &instr_DEC, .cycles = 5
 };
 Opcode op_C8 = {
-  .name = "INY", .op = &do_C8, .write = false, .addr_mode = ADDR_IMPLICIT
+  .name = "INY", .op = &do_C8, .write = false, .addr_mode = ADDR_IMPLICIT,
+  .instr = &instr_INY, .cycles = 2
 };
 Opcode op_C9 = {
-  .name = "CMP", .op = &do_C9, .write = false, .addr_mode = ADDR_IMMEDIATE
+  .name = "CMP", .op = &do_C9, .write = false, .addr_mode = ADDR_IMMEDIATE,
+  .instr = &instr_CMP, .cycles = 2
 };
 Opcode op_CA = {
-  .name = "DEX", .op = &do_CA, .write = false, .addr_mode = ADDR_IMPLICIT
+  .name = "DEX", .op = &do_CA, .write = false, .addr_mode = ADDR_IMPLICIT,
+  .instr = &instr_DEX, .cycles = 2
 };
 Opcode op_CC = {
-  .name = "CPY", .op = &do_CC, .write = false, .addr_mode = ADDR_ABSOLUTE
+  .name = "CPY", .op = &do_CC, .write = false, .addr_mode = ADDR_ABSOLUTE,
+  .instr = &instr_CPY, .cycles = 4
 };
 Opcode op_CD = {
-  .name = "CMP", .op = &do_CD, .write = false, .addr_mode = ADDR_ABSOLUTE
+  .name = "CMP", .op = &do_CD, .write = false, .addr_mode = ADDR_ABSOLUTE,
+  .instr = &instr_CMP, .cycles = 4
 };
 Opcode op_CE = {
-  .name = "DEC", .op = &do_CE, .write = true, .addr_mode = ADDR_ABSOLUTE
+  .name = "DEC", .op = &do_CE, .write = true, .addr_mode = ADDR_ABSOLUTE,
+  .instr = &instr_DEC, .cycles = 6
 };
 Opcode op_D0 = {
-  .name = "BNE", .op = &do_D0, .write = false, .addr_mode = ADDR_RELATIVE
+  .name = "BNE", .op = &do_D0, .write = false, .addr_mode = ADDR_RELATIVE,
+  .instr = &instr_BNE, .cycles = 2
 };
 Opcode op_D1 = {
-  .name = "CMP", .op = &do_D1, .write = false, .addr_mode = ADDR_IND_INDEX
+  .name = "CMP", .op = &do_D1, .write = false, .addr_mode = ADDR_IND_INDEX,
+  .instr = &instr_CMP, .cycles = 5
 };
 Opcode op_D5 = {
-  .name = "CMP", .op = &do_D5, .write = false, .addr_mode = ADDR_ZPG_X
+  .name = "CMP", .op = &do_D5, .write = false, .addr_mode = ADDR_ZPG_X,
+  .instr = &instr_CMP, .cycles = 4
 };
 Opcode op_D6 = {
-  .name = "DEC", .op = &do_D6, .write = true, .addr_mode = ADDR_ZPG_X
+  .name = "DEC", .op = &do_D6, .write = true, .addr_mode = ADDR_ZPG_X,
+  .instr = &instr_DEC, .cycles = 6
 };
 Opcode op_D8 = {
-  .name = "CLD", .op = &do_D8, .write = false, .addr_mode = ADDR_IMPLICIT
+  .name = "CLD", .op = &do_D8, .write = false, .addr_mode = ADDR_IMPLICIT,
+  .instr = &instr_CLD, .cycles = 2
 };
 Opcode op_D9 = {
-  .name = "CMP", .op = &do_D9, .write = false, .addr_mode = ADDR_ABSOLUTE_Y
+  .name = "CMP", .op = &do_D9, .write = false, .addr_mode = ADDR_ABSOLUTE_Y,
+  .instr = &instr_CMP, .cycles = 4
 };
 Opcode op_DD = {
-  .name = "CMP", .op = &do_DD, .write = false, .addr_mode = ADDR_ABSOLUTE_X
+  .name = "CMP", .op = &do_DD, .write = false, .addr_mode = ADDR_ABSOLUTE_X,
+  .instr = &instr_CMP, .cycles = 4
 };
 Opcode op_DE = {
-  .name = "DEC", .op = &do_DE, .write = true, .addr_mode = ADDR_ABSOLUTE_X
+  .name = "DEC", .op = &do_DE, .write = true, .addr_mode = ADDR_ABSOLUTE_X,
+  .instr = &instr_DEC, .cycles = 7
 };
 Opcode op_E0 = {
-  .name = "CPX", .op = &do_E0, .write = false, .addr_mode = ADDR_IMMEDIATE
+  .name = "CPX", .op = &do_E0, .write = false, .addr_mode = ADDR_IMMEDIATE,
+  .instr = &instr_CPX, .cycles = 2
 };
 Opcode op_E1 = {
-  .name = "SBC", .op = &do_E1, .write = false, .addr_mode = ADDR_INDEX_IND
+  .name = "SBC", .op = &do_E1, .write = false, .addr_mode = ADDR_INDEX_IND,
+  .instr = &instr_SBC, .cycles = 6
 };
 Opcode op_E4 = {
-  .name = "CPX", .op = &do_E4, .write = false, .addr_mode = ADDR_ZPG
+  .name = "CPX", .op = &do_E4, .write = false, .addr_mode = ADDR_ZPG,
+  .instr = &instr_CPX, .cycles = 3
 };
 Opcode op_E5 = {
-  .name = "SBC", .op = &do_E5, .write = false, .addr_mode = ADDR_ZPG
+  .name = "SBC", .op = &do_E5, .write = false, .addr_mode = ADDR_ZPG,
+  .instr = &instr_SBC, .cycles = 3
 };
 Opcode op_E6 = {
-  .name = "INC", .op = &do_E6, .write = true, .addr_mode = ADDR_ZPG
+  .name = "INC", .op = &do_E6, .write = true, .addr_mode = ADDR_ZPG,
+  .instr = &instr_INC, .cycles = 5
 };
 Opcode op_E8 = {
-  .name = "INX", .op = &do_E8, .write = false, .addr_mode = ADDR_IMPLICIT
+  .name = "INX", .op = &do_E8, .write = false, .addr_mode = ADDR_IMPLICIT,
+  .instr = &instr_INX, .cycles = 2
 };
 Opcode op_E9 = {
-  .name = "SBC", .op = &do_E9, .write = false, .addr_mode = ADDR_IMMEDIATE
+  .name = "SBC", .op = &do_E9, .write = false, .addr_mode = ADDR_IMMEDIATE,
+  .instr = &instr_SBC, .cycles = 2
 };
 Opcode op_EA = {
-  .name = "NOP", .op = &do_EA, .write = false, .addr_mode = ADDR_IMPLICIT
+  .name = "NOP", .op = &do_EA, .write = false, .addr_mode = ADDR_IMPLICIT,
+  .instr = &instr_NOP, .cycles = 2
 };
 Opcode op_EC = {
-  .name = "CPX", .op = &do_EC, .write = false, .addr_mode = ADDR_ABSOLUTE
+  .name = "CPX", .op = &do_EC, .write = false, .addr_mode = ADDR_ABSOLUTE,
+  .instr = &instr_CPX, .cycles = 4
 };
 Opcode op_ED = {
-  .name = "SBC", .op = &do_ED, .write = false, .addr_mode = ADDR_ABSOLUTE
+  .name = "SBC", .op = &do_ED, .write = false, .addr_mode = ADDR_ABSOLUTE,
+  .instr = &instr_SBC, .cycles = 4
 };
 Opcode op_EE = {
-  .name = "INC", .op = &do_EE, .write = true, .addr_mode = ADDR_ABSOLUTE
+  .name = "INC", .op = &do_EE, .write = true, .addr_mode = ADDR_ABSOLUTE,
+  .instr = &instr_INC, .cycles = 6
 };
 Opcode op_F0 = {
-  .name = "BEQ", .op = &do_F0, .write = false, .addr_mode = ADDR_RELATIVE
+  .name = "BEQ", .op = &do_F0, .write = false, .addr_mode = ADDR_RELATIVE,
+  .instr = &instr_BEQ, .cycles = 2
 };
 Opcode op_F1 = {
-  .name = "SBC", .op = &do_F1, .write = false, .addr_mode = ADDR_IND_INDEX
+  .name = "SBC", .op = &do_F1, .write = false, .addr_mode = ADDR_IND_INDEX,
+  .instr = &instr_SBC, .cycles = 5
 };
 Opcode op_F5 = {
-  .name = "SBC", .op = &do_F5, .write = false, .addr_mode = ADDR_ZPG_X
+  .name = "SBC", .op = &do_F5, .write = false, .addr_mode = ADDR_ZPG_X,
+  .instr = &instr_SBC, .cycles = 4
 };
 Opcode op_F6 = {
-  .name = "INC", .op = &do_F6, .write = true, .addr_mode = ADDR_ZPG_X
+  .name = "INC", .op = &do_F6, .write = true, .addr_mode = ADDR_ZPG_X,
+  .instr = &instr_INC, .cycles = 6
 };
 Opcode op_F8 = {
-  .name = "SED", .op = &do_F8, .write = false, .addr_mode = ADDR_IMPLICIT
+  .name = "SED", .op = &do_F8, .write = false, .addr_mode = ADDR_IMPLICIT,
+  .instr = &instr_SED, .cycles = 2
 };
 Opcode op_F9 = {
-  .name = "SBC", .op = &do_F9, .write = false, .addr_mode = ADDR_ABSOLUTE_Y
+  .name = "SBC", .op = &do_F9, .write = false, .addr_mode = ADDR_ABSOLUTE_Y,
+  .instr = &instr_SBC, .cycles = 4
 };
 Opcode op_FD = {
-  .name = "SBC", .op = &do_FD, .write = false, .addr_mode = ADDR_ABSOLUTE_X
+  .name = "SBC", .op = &do_FD, .write = false, .addr_mode = ADDR_ABSOLUTE_X,
+  .instr = &instr_SBC, .cycles = 4
 };
 Opcode op_FE = {
-  .name = "INC", .op = &do_FE, .write = true, .addr_mode = ADDR_ABSOLUTE_X
+  .name = "INC", .op = &do_FE, .write = true, .addr_mode = ADDR_ABSOLUTE_X,
+  .instr = &instr_INC, .cycles = 7
 };
 
 Opcode* opcodes[0x100] = {
@@ -2621,7 +2792,167 @@ Opcode* opcodes[0x100] = {
 };
 
 void run_opcode(M6502* cpu)  {
+#if defined(DISPATCH_TABLE)
   (*opcodes[cpu->IR >> 3]->op)(cpu);
+#else
+  // Jump straight into the handler instead of going through the opcode table
+  // and an indirect call. The handlers live in this file, so the compiler is
+  // free to inline them right here.
+  switch(cpu->IR >> 3) {
+  case 0x00: do_00(cpu); return;
+  case 0x01: do_01(cpu); return;
+  case 0x05: do_05(cpu); return;
+  case 0x06: do_06(cpu); return;
+  case 0x08: do_08(cpu); return;
+  case 0x09: do_09(cpu); return;
+  case 0x0A: do_0A(cpu); return;
+  case 0x0D: do_0D(cpu); return;
+  case 0x0E: do_0E(cpu); return;
+  case 0x10: do_10(cpu); return;
+  case 0x11: do_11(cpu); return;
+  case 0x15: do_15(cpu); return;
+  case 0x16: do_16(cpu); return;
+  case 0x18: do_18(cpu); return;
+  case 0x19: do_19(cpu); return;
+  case 0x1D: do_1D(cpu); return;
+  case 0x1E: do_1E(cpu); return;
+  case 0x20: do_20(cpu); return;
+  case 0x21: do_21(cpu); return;
+  case 0x24: do_24(cpu); return;
+  case 0x25: do_25(cpu); return;
+  case 0x26: do_26(cpu); return;
+  case 0x28: do_28(cpu); return;
+  case 0x29: do_29(cpu); return;
+  case 0x2A: do_2A(cpu); return;
+  case 0x2C: do_2C(cpu); return;
+  case 0x2D: do_2D(cpu); return;
+  case 0x2E: do_2E(cpu); return;
+  case 0x30: do_30(cpu); return;
+  case 0x31: do_31(cpu); return;
+  case 0x35: do_35(cpu); return;
+  case 0x36: do_36(cpu); return;
+  case 0x38: do_38(cpu); return;
+  case 0x39: do_39(cpu); return;
+  case 0x3D: do_3D(cpu); return;
+  case 0x3E: do_3E(cpu); return;
+  case 0x40: do_40(cpu); return;
+  case 0x41: do_41(cpu); return;
+  case 0x45: do_45(cpu); return;
+  case 0x46: do_46(cpu); return;
+  case 0x48: do_48(cpu); return;
+  case 0x49: do_49(cpu); return;
+  case 0x4A: do_4A(cpu); return;
+  case 0x4C: do_4C(cpu); return;
+  case 0x4D: do_4D(cpu); return;
+  case 0x4E: do_4E(cpu); return;
+  case 0x50: do_50(cpu); return;
+  case 0x51: do_51(cpu); return;
+  case 0x55: do_55(cpu); return;
+  case 0x56: do_56(cpu); return;
+  case 0x58: do_58(cpu); return;
+  case 0x59: do_59(cpu); return;
+  case 0x5D: do_5D(cpu); return;
+  case 0x5E: do_5E(cpu); return;
+  case 0x60: do_60(cpu); return;
+  case 0x61: do_61(cpu); return;
+  case 0x65: do_65(cpu); return;
+  case 0x66: do_66(cpu); return;
+  case 0x68: do_68(cpu); return;
+  case 0x69: do_69(cpu); return;
+  case 0x6A: do_6A(cpu); return;
+  case 0x6C: do_6C(cpu); return;
+  case 0x6D: do_6D(cpu); return;
+  case 0x6E: do_6E(cpu); return;
+  case 0x70: do_70(cpu); return;
+  case 0x71: do_71(cpu); return;
+  case 0x75: do_75(cpu); return;
+  case 0x76: do_76(cpu); return;
+  case 0x78: do_78(cpu); return;
+  case 0x79: do_79(cpu); return;
+  case 0x7D: do_7D(cpu); return;
+  case 0x7E: do_7E(cpu); return;
+  case 0x81: do_81(cpu); return;
+  case 0x84: do_84(cpu); return;
+  case 0x85: do_85(cpu); return;
+  case 0x86: do_86(cpu); return;
+  case 0x88: do_88(cpu); return;
+  case 0x8A: do_8A(cpu); return;
+  case 0x8C: do_8C(cpu); return;
+  case 0x8D: do_8D(cpu); return;
+  case 0x8E: do_8E(cpu); return;
+  case 0x90: do_90(cpu); return;
+  case 0x91: do_91(cpu); return;
+  case 0x94: do_94(cpu); return;
+  case 0x95: do_95(cpu); return;
+  case 0x96: do_96(cpu); return;
+  case 0x98: do_98(cpu); return;
+  case 0x99: do_99(cpu); return;
+  case 0x9A: do_9A(cpu); return;
+  case 0x9D: do_9D(cpu); return;
+  case 0xA0: do_A0(cpu); return;
+  case 0xA1: do_A1(cpu); return;
+  case 0xA2: do_A2(cpu); return;
+  case 0xA4: do_A4(cpu); return;
+  case 0xA5: do_A5(cpu); return;
+  case 0xA6: do_A6(cpu); return;
+  case 0xA8: do_A8(cpu); return;
+  case 0xA9: do_A9(cpu); return;
+  case 0xAA: do_AA(cpu); return;
+  case 0xAC: do_AC(cpu); return;
+  case 0xAD: do_AD(cpu); return;
+  case 0xAE: do_AE(cpu); return;
+  case 0xB0: do_B0(cpu); return;
+  case 0xB1: do_B1(cpu); return;
+  case 0xB4: do_B4(cpu); return;
+  case 0xB5: do_B5(cpu); return;
+  case 0xB6: do_B6(cpu); return;
+  case 0xB8: do_B8(cpu); return;
+  case 0xB9: do_B9(cpu); return;
+  case 0xBA: do_BA(cpu); return;
+  case 0xBC: do_BC(cpu); return;
+  case 0xBD: do_BD(cpu); return;
+  case 0xBE: do_BE(cpu); return;
+  case 0xC0: do_C0(cpu); return;
+  case 0xC1: do_C1(cpu); return;
+  case 0xC4: do_C4(cpu); return;
+  case 0xC5: do_C5(cpu); return;
+  case 0xC6: do_C6(cpu); return;
+  case 0xC8: do_C8(cpu); return;
+  case 0xC9: do_C9(cpu); return;
+  case 0xCA: do_CA(cpu); return;
+  case 0xCC: do_CC(cpu); return;
+  case 0xCD: do_CD(cpu); return;
+  case 0xCE: do_CE(cpu); return;
+  case 0xD0: do_D0(cpu); return;
+  case 0xD1: do_D1(cpu); return;
+  case 0xD5: do_D5(cpu); return;
+  case 0xD6: do_D6(cpu); return;
+  case 0xD8: do_D8(cpu); return;
+  case 0xD9: do_D9(cpu); return;
+  case 0xDD: do_DD(cpu); return;
+  case 0xDE: do_DE(cpu); return;
+  case 0xE0: do_E0(cpu); return;
+  case 0xE1: do_E1(cpu); return;
+  case 0xE4: do_E4(cpu); return;
+  case 0xE5: do_E5(cpu); return;
+  case 0xE6: do_E6(cpu); return;
+  case 0xE8: do_E8(cpu); return;
+  case 0xE9: do_E9(cpu); return;
+  case 0xEA: do_EA(cpu); return;
+  case 0xEC: do_EC(cpu); return;
+  case 0xED: do_ED(cpu); return;
+  case 0xEE: do_EE(cpu); return;
+  case 0xF0: do_F0(cpu); return;
+  case 0xF1: do_F1(cpu); return;
+  case 0xF5: do_F5(cpu); return;
+  case 0xF6: do_F6(cpu); return;
+  case 0xF8: do_F8(cpu); return;
+  case 0xF9: do_F9(cpu); return;
+  case 0xFD: do_FD(cpu); return;
+  case 0xFE: do_FE(cpu); return;
+  default: do_XX(cpu); return;
+  }
+#endif
 }
 
 void print_disassembly(M6502* cpu, uint16_t addr, unsigned int num_instr) {
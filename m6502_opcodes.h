@@ -48,6 +48,10 @@ typedef struct {
   opcode_func op;
   bool write;
   int addr_mode;
+  // For the instruction-level engine: handler for the whole instruction, and
+  // the cycles it takes without page crossing or branch penalties
+  instr_func instr;
+  uint8_t cycles;
 } Opcode;
 
 void run_opcode(M6502* cpu);
@@ -0,0 +1,267 @@
+/***************************************************************************
+ *   m6502_profile.c  --  This file is part of apple1emu.                  *
+ *                                                                         *
+ *   Copyright (C) 2021 Imanol-Mikel Barba Sabariego                       *
+ *                                                                         *
+ *   apple1emu is free software: you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published     *
+ *   by the Free Software Foundation, either version 3 of the License,     *
+ *   or (at your option) any later version.                                *
+ *                                                                         *
+ *   apple1emu is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty           *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.               *
+ *   See the GNU General Public License for more details.                  *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "m6502_profile.h"
+#include "m6502_opcodes.h"
+#include "errors.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern Opcode* opcodes[0x100];
+
+// What the report sorts by, qsort has no way to pass it along. Per thread, as
+// every machine could be printing its own
+static _Thread_local const unsigned long long* sort_cycles;
+
+int compare_cycles(const void* a, const void* b) {
+  unsigned long long cycles_a = sort_cycles[*(const unsigned int*)a];
+  unsigned long long cycles_b = sort_cycles[*(const unsigned int*)b];
+  return (cycles_a < cycles_b) - (cycles_a > cycles_b);
+}
+
+static uint32_t find_child(Call_profile* profile, uint32_t parent, uint16_t entry) {
+  for(uint32_t i = profile->nodes[parent].child; i; i = profile->nodes[i].sibling) {
+    if(profile->nodes[i].entry == entry) {
+      return i;
+    }
+  }
+  if(profile->num_nodes == profile->max_nodes) {
+    Call_node* nodes = realloc(profile->nodes, 2 * profile->max_nodes * sizeof(Call_node));
+    if(nodes == NULL) {
+      // Keep going, just merging it into the caller
+      return parent;
+    }
+    profile->nodes = nodes;
+    profile->max_nodes *= 2;
+  }
+  uint32_t node = profile->num_nodes++;
+  profile->nodes[node].entry = entry;
+  profile->nodes[node].parent = parent;
+  profile->nodes[node].child = 0;
+  profile->nodes[node].sibling = profile->nodes[parent].child;
+  profile->nodes[node].cycles = 0;
+  profile->nodes[parent].child = node;
+  return node;
+}
+
+static void pop_frame(Call_profile* profile) {
+  Call_frame* frame = &profile->stack[--profile->depth];
+  uint16_t entry = profile->nodes[frame->node].entry;
+  for(unsigned int i = 0; i < profile->depth; ++i) {
+    if(profile->nodes[profile->stack[i].node].entry == entry) {
+      // Recursive, the outermost call already accounts for this one
+      return;
+    }
+  }
+  profile->inclusive[entry] += profile->total - frame->start;
+}
+
+int init_call_profile(M6502* cpu) {
+  if(cpu->call_profile != NULL) {
+    return SUCCESS;
+  }
+  Call_profile* profile = calloc(1, sizeof(Call_profile));
+  if(profile == NULL) {
+    fprintf(stderr, "Unable to alloc call profiler\n");
+    return ERROR_MEMORY_ALLOC;
+  }
+  profile->nodes = calloc(CALL_NODES_INITIAL, sizeof(Call_node));
+  if(profile->nodes == NULL) {
+    fprintf(stderr, "Unable to alloc call profiler\n");
+    free(profile);
+    return ERROR_MEMORY_ALLOC;
+  }
+  profile->max_nodes = CALL_NODES_INITIAL;
+  profile->num_nodes = 1;
+  cpu->call_profile = profile;
+  return SUCCESS;
+}
+
+void destroy_call_profile(M6502* cpu) {
+  if(cpu->call_profile == NULL) {
+    return;
+  }
+  free(cpu->call_profile->nodes);
+  free(cpu->call_profile);
+  cpu->call_profile = NULL;
+}
+
+void profile_call(Call_profile* profile, uint16_t entry, uint8_t sp) {
+  // Anything at or below this stack pointer has been abandoned, by moving S
+  // around instead of returning
+  while(profile->depth && profile->stack[profile->depth - 1].sp <= sp) {
+    pop_frame(profile);
+  }
+  uint32_t parent = profile->depth ? profile->stack[profile->depth - 1].node : 0;
+  profile->calls[entry]++;
+  if(profile->depth == CALL_STACK_DEPTH) {
+    return;
+  }
+  Call_frame* frame = &profile->stack[profile->depth++];
+  frame->node = find_child(profile, parent, entry);
+  frame->sp = sp;
+  frame->start = profile->total;
+}
+
+void profile_return(Call_profile* profile, uint8_t sp) {
+  // The return address of the frame on top is right below sp now. Pulling more
+  // than that means some frames were left without returning
+  while(profile->depth && profile->stack[profile->depth - 1].sp < sp) {
+    pop_frame(profile);
+  }
+}
+
+void profile_interrupt(Call_profile* profile, bool reset, uint16_t entry, uint8_t sp) {
+  if(!reset) {
+    profile_call(profile, entry, sp);
+    return;
+  }
+  // Nothing is coming back from a reset
+  while(profile->depth) {
+    pop_frame(profile);
+  }
+}
+
+int init_profile(M6502* cpu) {
+  if(cpu->profile != NULL) {
+    return SUCCESS;
+  }
+  Profile* profile = calloc(1, sizeof(Profile));
+  if(profile == NULL) {
+    fprintf(stderr, "Unable to alloc profiler\n");
+    return ERROR_MEMORY_ALLOC;
+  }
+  cpu->profile = profile;
+  return SUCCESS;
+}
+
+void destroy_profile(M6502* cpu) {
+  free(cpu->profile);
+  cpu->profile = NULL;
+}
+
+void clear_profile(Profile* profile) {
+  memset(profile, 0, sizeof(Profile));
+}
+
+void print_profile(M6502* cpu) {
+  Profile* profile = cpu->profile;
+  if(profile == NULL) {
+    printf("Profiler is not enabled\n");
+    return;
+  }
+  unsigned int* order = malloc(MEMSIZE * sizeof(unsigned int));
+  if(order == NULL) {
+    fprintf(stderr, "Unable to alloc profile report\n");
+    return;
+  }
+  unsigned long long total = 0;
+  for(unsigned int i = 0; i < 0x100; ++i) {
+    total += profile->opcode_cycles[i];
+  }
+  if(!total) {
+    total = 1;
+  }
+
+  for(unsigned int i = 0; i < 0x100; ++i) {
+    order[i] = i;
+  }
+  sort_cycles = profile->opcode_cycles;
+  qsort(order, 0x100, sizeof(unsigned int), compare_cycles);
+  printf("== OPCODES ==\n");
+  printf("%-6s %-4s %12s %14s %6s\n", "OPCODE", "NAME", "COUNT", "CYCLES", "%");
+  for(unsigned int i = 0; i < PROFILE_REPORT_ROWS && profile->opcode_count[order[i]]; ++i) {
+    unsigned int op = order[i];
+    printf("0x%02X   %-4s %12llu %14llu %5.1f%%\n", op, opcodes[op]->name,
+      profile->opcode_count[op], profile->opcode_cycles[op], 100.0 * profile->opcode_cycles[op] / total);
+  }
+
+  for(unsigned int i = 0; i < MEMSIZE; ++i) {
+    order[i] = i;
+  }
+  sort_cycles = profile->pc_cycles;
+  qsort(order, MEMSIZE, sizeof(unsigned int), compare_cycles);
+  printf("== ADDRESSES ==\n");
+  printf("%12s %14s %6s  %s\n", "COUNT", "CYCLES", "%", "INSTRUCTION");
+  for(unsigned int i = 0; i < PROFILE_REPORT_ROWS && profile->pc_count[order[i]]; ++i) {
+    unsigned int pc = order[i];
+    printf("%12llu %14llu %5.1f%%  ", profile->pc_count[pc], profile->pc_cycles[pc], 100.0 * profile->pc_cycles[pc] / total);
+    print_disassembly(cpu, pc, 1);
+  }
+  free(order);
+}
+
+void print_call_profile(M6502* cpu) {
+  Call_profile* profile = cpu->call_profile;
+  if(profile == NULL) {
+    printf("Call profiler is not enabled\n");
+    return;
+  }
+  unsigned int* order = malloc(MEMSIZE * sizeof(unsigned int));
+  if(order == NULL) {
+    fprintf(stderr, "Unable to alloc profile report\n");
+    return;
+  }
+  unsigned long long total = profile->total ? profile->total : 1;
+  for(unsigned int i = 0; i < MEMSIZE; ++i) {
+    order[i] = i;
+  }
+  sort_cycles = profile->inclusive;
+  qsort(order, MEMSIZE, sizeof(unsigned int), compare_cycles);
+  printf("== SUBROUTINES ==\n");
+  printf("%-6s %12s %14s %6s %14s %6s\n", "ENTRY", "CALLS", "INCLUSIVE", "%", "EXCLUSIVE", "%");
+  for(unsigned int i = 0; i < PROFILE_REPORT_ROWS && profile->calls[order[i]]; ++i) {
+    unsigned int entry = order[i];
+    printf("0x%04X %12llu %14llu %5.1f%% %14llu %5.1f%%\n", entry, profile->calls[entry],
+      profile->inclusive[entry], 100.0 * profile->inclusive[entry] / total,
+      profile->exclusive[entry], 100.0 * profile->exclusive[entry] / total);
+  }
+  free(order);
+}
+
+int write_folded_stacks(Call_profile* profile, const char* path) {
+  FILE* f = fopen(path, "w");
+  if(f == NULL) {
+    fprintf(stderr, "Error opening file: %s\n", path);
+    return ERROR_OPEN_FILE;
+  }
+  uint16_t path_entries[CALL_STACK_DEPTH];
+  for(uint32_t i = 0; i < profile->num_nodes; ++i) {
+    if(!profile->nodes[i].cycles) {
+      continue;
+    }
+    unsigned int depth = 0;
+    for(uint32_t node = i; node; node = profile->nodes[node].parent) {
+      path_entries[depth++] = profile->nodes[node].entry;
+    }
+    fprintf(f, "root");
+    while(depth) {
+      fprintf(f, ";%04X", path_entries[--depth]);
+    }
+    fprintf(f, " %llu\n", profile->nodes[i].cycles);
+  }
+  if(fclose(f)) {
+    fprintf(stderr, "Error writing file: %s\n", path);
+    return ERROR_WRITE_FILE;
+  }
+  return SUCCESS;
+}
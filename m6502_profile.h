@@ -0,0 +1,136 @@
+/***************************************************************************
+ *   m6502_profile.h  --  This file is part of apple1emu.                  *
+ *                                                                         *
+ *   Copyright (C) 2021 Imanol-Mikel Barba Sabariego                       *
+ *                                                                         *
+ *   apple1emu is free software: you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published     *
+ *   by the Free Software Foundation, either version 3 of the License,     *
+ *   or (at your option) any later version.                                *
+ *                                                                         *
+ *   apple1emu is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty           *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.               *
+ *   See the GNU General Public License for more details.                  *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef M6502_PROFILE_H
+#define M6502_PROFILE_H
+
+#include "m6502.h"
+
+// Rows printed for each table of the report
+#define PROFILE_REPORT_ROWS 20
+
+// Executions and cycles per opcode and per address. Cycles are only known once
+// the next instruction starts, so every instruction is accounted for then.
+typedef struct Profile {
+  unsigned long long opcode_count[0x100];
+  unsigned long long opcode_cycles[0x100];
+  unsigned long long pc_count[MEMSIZE];
+  unsigned long long pc_cycles[MEMSIZE];
+
+  bool started;
+  uint16_t last_pc;
+  uint8_t last_opcode;
+  unsigned long long last_tick;
+} Profile;
+
+int init_profile(M6502* cpu);
+void destroy_profile(M6502* cpu);
+void clear_profile(Profile* profile);
+// Hottest opcodes and addresses by cycles, to stdout
+void print_profile(M6502* cpu);
+
+// Deepest guest call stack followed. Every frame takes at least 2 bytes of
+// the 6502 stack, so this is only hit if it's being left unbalanced
+#define CALL_STACK_DEPTH 128
+#define CALL_NODES_INITIAL 1024
+
+// Every distinct guest call stack seen, as a tree rooted at whatever runs
+// outside of any subroutine (node 0)
+typedef struct {
+  uint16_t entry;
+  uint32_t parent;
+  uint32_t child;
+  uint32_t sibling;
+  // Cycles spent in this very stack, not in deeper calls
+  unsigned long long cycles;
+} Call_node;
+
+typedef struct {
+  uint32_t node;
+  // Stack pointer right after pushing the return address
+  uint8_t sp;
+  // Cycles attributed so far when it was called
+  unsigned long long start;
+} Call_frame;
+
+// Shadow call stack, fed by JSR/RTS, interrupts and RTI on both engines.
+// Inclusive and exclusive cycles are per subroutine entry address
+typedef struct Call_profile {
+  unsigned long long calls[MEMSIZE];
+  unsigned long long inclusive[MEMSIZE];
+  unsigned long long exclusive[MEMSIZE];
+
+  Call_node* nodes;
+  uint32_t num_nodes;
+  uint32_t max_nodes;
+
+  Call_frame stack[CALL_STACK_DEPTH];
+  unsigned int depth;
+
+  bool started;
+  unsigned long long last_tick;
+  unsigned long long total;
+} Call_profile;
+
+int init_call_profile(M6502* cpu);
+void destroy_call_profile(M6502* cpu);
+// JSR, IRQ, NMI and BRK, once the return address has been pushed and PC
+// points to the subroutine
+void profile_call(Call_profile* profile, uint16_t entry, uint8_t sp);
+// RTS and RTI, once everything's been pulled
+void profile_return(Call_profile* profile, uint8_t sp);
+void profile_interrupt(Call_profile* profile, bool reset, uint16_t entry, uint8_t sp);
+// Subroutines taking the most cycles, to stdout
+void print_call_profile(M6502* cpu);
+// One line per stack, the way flame graph scripts take them
+int write_folded_stacks(Call_profile* profile, const char* path);
+
+// Called on every instruction start, only while cpu->call_profile is set. The
+// cycles since the last one go to whatever is on top of the stack now
+static inline void profile_call_cycles(Call_profile* profile, unsigned long long tick) {
+  if(profile->started) {
+    unsigned long long cycles = tick - profile->last_tick;
+    Call_node* node = &profile->nodes[profile->depth ? profile->stack[profile->depth - 1].node : 0];
+    node->cycles += cycles;
+    if(profile->depth) {
+      profile->exclusive[node->entry] += cycles;
+    }
+    profile->total += cycles;
+  }
+  profile->started = true;
+  profile->last_tick = tick;
+}
+
+// Called on every instruction start, only while cpu->profile is set
+static inline void profile_instruction(Profile* profile, uint16_t pc, uint8_t opcode, unsigned long long tick) {
+  if(profile->started) {
+    unsigned long long cycles = tick - profile->last_tick;
+    profile->opcode_count[profile->last_opcode]++;
+    profile->opcode_cycles[profile->last_opcode] += cycles;
+    profile->pc_count[profile->last_pc]++;
+    profile->pc_cycles[profile->last_pc] += cycles;
+  }
+  profile->started = true;
+  profile->last_pc = pc;
+  profile->last_opcode = opcode;
+  profile->last_tick = tick;
+}
+
+#endif
@@ -19,6 +19,8 @@
  ***************************************************************************/
 
 #include "apple1.h"
+#include "batch.h"
+#include "rewind.h"
 #include "errors.h"
 
 #include <stdio.h>
@@ -42,12 +44,34 @@ static struct option long_options[] = {
   {"binary", required_argument, NULL, 'b'},
   {"start-addr", required_argument, NULL, 'a'},
   {"load-addr", required_argument, NULL, 'l'},
+  {"fast", no_argument, NULL, 'f'},
+  {"jit", no_argument, NULL, 'j'},
+  {"profile", no_argument, NULL, 'p'},
+  {"calls", required_argument, NULL, 'c'},
+  {"bench", no_argument, NULL, 'B'},
+  {"cycles", required_argument, NULL, 'n'},
+  {"stop-pc", required_argument, NULL, 's'},
+  {"manifest", required_argument, NULL, 'M'},
+  {"results", required_argument, NULL, 'o'},
+  {"threads", required_argument, NULL, 't'},
+  {"state", required_argument, NULL, 'S'},
+  {"slot", required_argument, NULL, 'L'},
+  {"rewind", required_argument, NULL, 'w'},
+  {"quantum", required_argument, NULL, 'q'},
+  {"realtime", required_argument, NULL, 'R'},
+  {"fifo", no_argument, NULL, 'F'},
+  {"spin", required_argument, NULL, 'W'},
+  {"display-rate", required_argument, NULL, 'd'},
+  {"paste", required_argument, NULL, 'k'},
   {NULL, 0, NULL, 0}
 };
 
+// The one machine on the terminal, for the signal handler
+static Apple1Machine* machine = NULL;
+
 void termination_handler(int signum) {
-  if(signum == SIGINT) {
-    halt_apple1();
+  if(signum == SIGINT && machine != NULL) {
+    halt_apple1(machine);
   }
 }
 
@@ -57,7 +81,7 @@ void print_version(const char* argv) {
 
 void print_help(const char* argv) {
   print_version(argv);
-  printf("%s [-r --rom ROM_PATH] [-e --extra EXTRA_RAM_PATH] [-m --mem USER_MEMORY_SIZE] [-b --binary PROGRAM] [-l --load-addr LOAD_ADDR] [-a --start-addr START_ADDR] [-h --help]\n", argv);
+  printf("%s [-r --rom ROM_PATH] [-e --extra EXTRA_RAM_PATH] [-m --mem USER_MEMORY_SIZE] [-b --binary PROGRAM] [-l --load-addr LOAD_ADDR] [-a --start-addr START_ADDR] [-f --fast] [-j --jit] [-p --profile] [-c --calls FOLDED_STACKS_PATH] [-B --bench [-n --cycles CYCLES] [-s --stop-pc ADDR]] [-M --manifest MANIFEST_PATH [-o --results RESULTS_PATH] [-t --threads THREADS]] [-S --state SAVESTATE_PATH] [-L --slot SLOT] [-w --rewind INTERVAL_MS] [-q --quantum CYCLES] [-R --realtime CORE [-F --fifo] [-W --spin SPIN_US]] [-d --display-rate CHARS_PER_SECOND] [-k --paste KEYS_PATH] [-h --help]\n", argv);
   printf("Just a simple Apple I emulator.\n\n");
 }
 
@@ -113,6 +137,25 @@ int main(int argc, char** argv) {
 
   uint16_t start_addr = 0x0000;
   uint16_t load_addr = 0x0000;
+  bool fast = false;
+  bool jit = false;
+  bool profile = false;
+  char* calls_path = NULL;
+  bool bench = false;
+  unsigned long long bench_cycles = DEFAULT_BENCH_CYCLES;
+  int stop_pc = -1;
+  char* manifest_path = NULL;
+  char* results_path = "-";
+  unsigned int threads = 0;
+  char* savestate_path = NULL;
+  unsigned int savestate_slot = 0;
+  unsigned int rewind_interval = DEFAULT_REWIND_INTERVAL;
+  unsigned int quantum = DEFAULT_CLOCK_QUANTUM;
+  int realtime_core = NO_CORE;
+  bool fifo = false;
+  long spin_us = -1;
+  unsigned int display_rate = 0;
+  char* paste_path = NULL;
 
   struct sigaction act;
   memset(&act, 0, sizeof(act));
@@ -128,7 +171,7 @@ int main(int argc, char** argv) {
 
   int c;
   int option_index;
-  while ((c = getopt_long(argc, argv, "hm:e:r:b:a:l:", long_options, &option_index)) != -1) {
+  while ((c = getopt_long(argc, argv, "hm:e:r:b:a:l:fjpc:Bn:s:M:o:t:S:L:w:q:R:FW:d:k:", long_options, &option_index)) != -1) {
     switch (c) {
       case 'm':
         user_memory_size = atoi(optarg);
@@ -148,6 +191,79 @@ int main(int argc, char** argv) {
       case 'l':
         load_addr = atoi(optarg);
       break;
+      case 'f':
+        fast = true;
+      break;
+      case 'j':
+        jit = true;
+      break;
+      case 'p':
+        profile = true;
+      break;
+      case 'c':
+        calls_path = optarg;
+      break;
+      case 'B':
+        bench = true;
+      break;
+      case 'n':
+        bench_cycles = strtoull(optarg, NULL, 0);
+      break;
+      case 's':
+        stop_pc = strtol(optarg, NULL, 0) & 0xFFFF;
+      break;
+      case 'M':
+        manifest_path = optarg;
+      break;
+      case 'o':
+        results_path = optarg;
+      break;
+      case 't':
+        threads = strtoul(optarg, NULL, 0);
+      break;
+      case 'S':
+        savestate_path = optarg;
+      break;
+      case 'L':
+        savestate_slot = strtoul(optarg, NULL, 10);
+      break;
+      case 'w':
+        rewind_interval = strtoul(optarg, NULL, 10);
+      break;
+      case 'q':
+        quantum = strtoul(optarg, NULL, 0);
+        if(!quantum) {
+          fprintf(stderr, "The quantum has to be at least 1 cycle\n");
+          exit(FAILURE);
+        }
+      break;
+      case 'R':
+        realtime_core = atoi(optarg);
+        if(realtime_core < 0) {
+          fprintf(stderr, "Invalid core: %s\n", optarg);
+          exit(FAILURE);
+        }
+      break;
+      case 'F':
+        fifo = true;
+      break;
+      case 'W':
+        spin_us = strtol(optarg, NULL, 10);
+        if(spin_us < 0) {
+          fprintf(stderr, "The spin time can't be negative\n");
+          exit(FAILURE);
+        }
+        if(spin_us > MAX_SPIN_US) {
+          fprintf(stderr, "The spin time can't be more than %d us\n", MAX_SPIN_US);
+          exit(FAILURE);
+        }
+      break;
+      case 'd':
+        display_rate = strtoul(optarg, NULL, 10);
+      break;
+      case 'k':
+        paste_path = optarg;
+      break;
       case 'h':
       case '?':
         print_help(argv[0]);
@@ -160,6 +276,12 @@ int main(int argc, char** argv) {
     }
   }
 
+  if(manifest_path != NULL) {
+    // Batch mode: every binary in the manifest runs on a machine of its own
+    int ret = run_batch(manifest_path, results_path, threads, fast, jit);
+    exit(ret == SUCCESS ? SUCCESS : FAILURE);
+  }
+
   if(rom_path == NULL && binary_path == NULL) {
     fprintf(stderr, "Missing argument: need to specify -r or -b\n");
     exit(FAILURE);
@@ -186,21 +308,60 @@ int main(int argc, char** argv) {
     }
   }
 
+  machine = create_apple1();
+  if(machine == NULL) {
+    exit(FAILURE);
+  }
   if(binary_path != NULL) {
     // Init the emulator in binary mode: running a custom binary in the whole
     // memory space area
-    init_apple1_binary(binary_data, binary_length, start_addr, load_addr);
+    init_apple1_binary(machine, binary_data, binary_length, start_addr, load_addr);
   } else {
-    init_apple1(user_memory_size, rom_data, rom_length, extra_data, extra_length);
+    init_apple1(machine, user_memory_size, rom_data, rom_length, extra_data, extra_length);
   }
-  int ret = boot_apple1();
-  if(ret != SUCCESS) {
+  if(savestate_path != NULL) {
+    machine->savestate_path = savestate_path;
+  }
+  machine->savestate_slot = savestate_slot;
+  machine->main_clock.quantum = quantum;
+  machine->main_clock.realtime_core = realtime_core;
+  machine->main_clock.realtime_fifo = fifo;
+  if(spin_us < 0) {
+    spin_us = realtime_core != NO_CORE ? DEFAULT_REALTIME_SPIN / 1000 : 0;
+  }
+  machine->main_clock.spin_ns = (unsigned long long)spin_us * 1000;
+  set_display_rate(machine, display_rate);
+  if(paste_path != NULL && set_paste(machine, paste_path) != SUCCESS) {
     exit(FAILURE);
   }
-  fprintf(stderr, "Halted apple I\n");
+  set_instruction_mode(machine, fast);
+  if(jit) {
+    set_jit(machine, true);
+  }
+  if(profile) {
+    set_profile(machine, true);
+  }
+  if(calls_path != NULL) {
+    set_call_profile(machine, calls_path);
+  }
+  int ret;
+  if(bench) {
+    ret = bench_apple1(machine, bench_cycles, stop_pc);
+  } else {
+    // Only worth it with someone at the keyboard
+    set_rewind(machine, rewind_interval);
+    ret = boot_apple1(machine);
+    if(ret == SUCCESS) {
+      fprintf(stderr, "Halted apple I\n");
+    }
+  }
+  Apple1Machine* halted = machine;
+  machine = NULL;
+  destroy_apple1(halted);
 
   free(rom_data);
   free(extra_data);
+  free(binary_data);
 
-  return 0;
+  return ret == SUCCESS ? SUCCESS : FAILURE;
 }
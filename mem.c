@@ -35,6 +35,8 @@ int init_mem(Mem_16* m, uint16_t start, uint16_t end) {
   }
   m->start_addr = start;
   m->end_addr = end;
+  m->write_listener = NULL;
+  memset(m->dirty, 0x00, sizeof(m->dirty));
   size_t mem_size = get_memsize(m);
   m->mem = calloc(mem_size, sizeof(uint8_t));
   if(m->mem == NULL) {
@@ -57,6 +59,10 @@ void clock_mem(void* ptr, bool status) {
     if(is_enabled_mem(m)) {
       if(!*m->RW) {
         m->mem[*(m->addr_bus) - m->start_addr] = *(m->data_bus);
+        mark_dirty(m, *(m->addr_bus));
+        if(m->write_listener != NULL) {
+          (*m->write_listener->callback)(m->write_listener->listener, *(m->addr_bus));
+        }
       } else {
         *(m->data_bus) = m->mem[*(m->addr_bus) - m->start_addr];
       }
@@ -75,9 +81,32 @@ int load_data(Mem_16* m, uint8_t* data, size_t data_size, uint16_t addr) {
     return ERROR_DATA_TOO_LARGE;
   }
   memcpy(m->mem + addr - m->start_addr, data, data_size);
+  if(data_size) {
+    mark_range_dirty(m, addr, addr + data_size - 1);
+  }
   return SUCCESS;
 }
 
+void mark_range_dirty(Mem_16* m, uint16_t start, uint16_t end) {
+  for(unsigned int page = start >> MEM_PAGE_SHIFT; page <= (unsigned int)(end >> MEM_PAGE_SHIFT); ++page) {
+    __atomic_fetch_or(&m->dirty[page / 64], 1ULL << (page % 64), __ATOMIC_RELEASE);
+  }
+}
+
+bool is_page_dirty(Mem_16* m, uint8_t page) {
+  return (__atomic_load_n(&m->dirty[page / 64], __ATOMIC_ACQUIRE) >> (page % 64)) & 1;
+}
+
+void get_dirty_pages(Mem_16* m, uint64_t* pages, bool clear) {
+  for(unsigned int i = 0; i < DIRTY_WORDS; ++i) {
+    if(clear) {
+      pages[i] = __atomic_exchange_n(&m->dirty[i], 0, __ATOMIC_ACQ_REL);
+    } else {
+      pages[i] = __atomic_load_n(&m->dirty[i], __ATOMIC_ACQUIRE);
+    }
+  }
+}
+
 void destroy_mem(Mem_16* m) {
   free(m->mem);
 }
@@ -25,6 +25,16 @@
 #include <stdbool.h>
 #include <stdlib.h>
 
+#define MEM_PAGE_SHIFT 8
+#define MEM_PAGES 0x100
+#define DIRTY_WORDS (MEM_PAGES / 64)
+
+typedef void (*write_callback)(void*, uint16_t);
+typedef struct {
+  write_callback callback;
+  void* listener;
+} Write_listener;
+
 typedef struct {
   uint16_t start_addr;
   uint16_t end_addr;
@@ -32,6 +42,11 @@ typedef struct {
   volatile uint16_t* addr_bus;
   volatile uint8_t* data_bus;
   bool* RW;
+  // Gets the address of every write done through the bus, if set
+  Write_listener* write_listener;
+  // A bit per 256 byte page of the address space, set on every write to it.
+  // Only the CPU thread sets them, anyone can take them with get_dirty_pages
+  uint64_t dirty[DIRTY_WORDS];
 } Mem_16;
 
 void clock_mem(void* ptr, bool status);
@@ -39,4 +54,22 @@ int init_mem(Mem_16* m, uint16_t start, uint16_t end);
 int load_data(Mem_16* m, uint8_t* data, size_t data_size, uint16_t addr);
 void destroy_mem(Mem_16* m);
 
+static inline void mark_dirty(Mem_16* m, uint16_t addr) {
+  uint64_t* word = &m->dirty[addr >> (MEM_PAGE_SHIFT + 6)];
+  uint64_t bit = 1ULL << ((addr >> MEM_PAGE_SHIFT) & 63);
+  // No locked instruction on the write path. Racing with get_dirty_pages can
+  // at worst bring back some bits it just cleared, never lose this one
+  uint64_t bits = __atomic_load_n(word, __ATOMIC_RELAXED);
+  if(!(bits & bit)) {
+    __atomic_store_n(word, bits | bit, __ATOMIC_RELEASE);
+  }
+}
+
+// For changes made straight to m->mem, without going through the bus
+void mark_range_dirty(Mem_16* m, uint16_t start, uint16_t end);
+bool is_page_dirty(Mem_16* m, uint8_t page);
+// Copies the bitmap of dirty pages to pages (DIRTY_WORDS long), clearing it
+// in the same go if asked to
+void get_dirty_pages(Mem_16* m, uint64_t* pages, bool clear);
+
 #endif
@@ -20,6 +20,7 @@
 
 #include "pia6821.h"
 #include "apple1.h"
+#include "errors.h"
 
 #include <termios.h>
 #include <unistd.h>
@@ -30,6 +31,8 @@
 #include <pthread.h>
 #include <sys/ioctl.h>
 #include <string.h>
+#include <time.h>
+#include <poll.h>
 
 struct termios orig_termios;
 
@@ -71,42 +74,121 @@ char apple_to_ascii[0x100] = {
   0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
 };
 
-// Linux has a 1024 buffer size for stdin (4096 if not reading from a tty), so
-// we really don't need to implement a buffer here
-unsigned char pressed_key;
-volatile bool data_ready = false;
+void init_keyboard(Keyboard_queue* q) {
+  q->head = 0;
+  q->tail = 0;
+  q->waiting = false;
+  pthread_mutex_init(&q->lock, NULL);
+  pthread_cond_init(&q->room, NULL);
+}
+
+void destroy_keyboard(Keyboard_queue* q) {
+  pthread_mutex_destroy(&q->lock);
+  pthread_cond_destroy(&q->room);
+}
 
-unsigned int current_col = 0;
+static bool keyboard_full(Keyboard_queue* q) {
+  return q->head - __atomic_load_n(&q->tail, __ATOMIC_SEQ_CST) == KEYBOARD_QUEUE_SIZE;
+}
 
-void process_peripheral_A(PIA6821* p) {
-  if(data_ready && !(p->CRA & 0x80)) {
-    char translated_char = ascii_to_apple[pressed_key];
+bool push_key(Keyboard_queue* q, unsigned char key, volatile bool* stop) {
+  if(keyboard_full(q)) {
+    pthread_mutex_lock(&q->lock);
+    __atomic_store_n(&q->waiting, true, __ATOMIC_SEQ_CST);
+    while(keyboard_full(q) && !*stop) {
+      struct timespec deadline;
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      deadline.tv_nsec += KEYBOARD_FULL_TIMEOUT;
+      if(deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+      }
+      pthread_cond_timedwait(&q->room, &q->lock, &deadline);
+    }
+    __atomic_store_n(&q->waiting, false, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&q->lock);
+    if(keyboard_full(q)) {
+      return false;
+    }
+  }
+  q->keys[q->head % KEYBOARD_QUEUE_SIZE] = key;
+  __atomic_store_n(&q->head, q->head + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+bool pop_key(Keyboard_queue* q, unsigned char* key) {
+  if(!key_waiting(q)) {
+    return false;
+  }
+  *key = q->keys[q->tail % KEYBOARD_QUEUE_SIZE];
+  __atomic_store_n(&q->tail, q->tail + 1, __ATOMIC_SEQ_CST);
+  if(__atomic_load_n(&q->waiting, __ATOMIC_SEQ_CST)) {
+    pthread_mutex_lock(&q->lock);
+    pthread_cond_signal(&q->room);
+    pthread_mutex_unlock(&q->lock);
+  }
+  return true;
+}
+
+// Runs as an event, once there's a key and the last one has been read
+void process_peripheral_A(void* ptr) {
+  PIA6821* p = (PIA6821*)ptr;
+  unsigned char key;
+  p->key_pending = false;
+  // Keys with no Apple I equivalent are dropped
+  while(!(p->CRA & 0x80) && pop_key(&p->keyboard, &key)) {
+    char translated_char = ascii_to_apple[key];
     if(translated_char != 0x00) {
       // The Apple I has PA7 always high
       p->PA = (uint8_t)translated_char | 0x80;
       p->CRA |= 0x80;
-      data_ready = false;
     }
   }
 }
 
-void process_peripheral_B(PIA6821* p) {
-  ssize_t written;
+// Right when the guest asks for it
+static void paste_key(PIA6821* p) {
+  unsigned char key;
+  while(!(p->CRA & 0x80) && pop_key(&p->paste, &key)) {
+    char translated_char = ascii_to_apple[key];
+    if(translated_char != 0x00) {
+      p->PA = (uint8_t)translated_char | 0x80;
+      p->CRA |= 0x80;
+    }
+  }
+}
+
+void deliver_key(PIA6821* p) {
+  if(!(p->CRA & 0x80) && !p->key_pending && key_waiting(&p->keyboard)) {
+    p->key_pending = schedule_event(p->scheduler, *p->scheduler->now, &process_peripheral_A, p) == SUCCESS;
+  }
+}
+
+// Runs as an event, display_cycles after the char was written
+void process_peripheral_B(void* ptr) {
+  PIA6821* p = (PIA6821*)ptr;
+  p->display_pending = false;
   if(p->PB & 0x80) {
-    p->PB &= 0x7F;
-    char translated_char = apple_to_ascii[p->PB];
+    char translated_char = apple_to_ascii[p->PB & 0x7F];
     if(translated_char != 0x00) {
+      char output[2];
+      size_t length = 0;
+      unsigned int col = p->current_col;
       if(translated_char == 0x0A) {
-        current_col = 0;
-      } else if(current_col++ == MAX_COLUMNS) {
-        write(STDOUT_FILENO, "\n", 1);
-        current_col = 1;
+        col = 0;
+      } else if(col++ == MAX_COLUMNS) {
+        output[length++] = '\n';
+        col = 1;
       }
-      written = write(STDOUT_FILENO, &translated_char, 1);
-      if(written == -1) {
-        fprintf(stderr, "Error printing character to stdout\n");
+      output[length++] = translated_char;
+      if(!display_put(p->display, output, length)) {
+        // The terminal is behind, so DA stays high until there's room
+        p->display_pending = schedule_event(p->scheduler, *p->scheduler->now + DISPLAY_BUSY_CYCLES, &process_peripheral_B, p) == SUCCESS;
+        return;
       }
+      p->current_col = col;
     }
+    p->PB &= 0x7F;
   }
 }
 
@@ -123,37 +205,66 @@ void clock_pia(void* ptr, bool status) {
     if(p->CRB & DDR_FLAG) {
       selected_data_register_B = &(p->PB);
     }
-    process_peripheral_A(p);
-    process_peripheral_B(p);
-    if(*p->RW) {
-      if(*p->addr_bus == p->CRA_ADDR) {
-        *p->data_bus = p->CRA;
-      } else if(*p->addr_bus == p->CRB_ADDR) {
-        *p->data_bus = p->CRB;
-      } else if(*p->addr_bus == p->PA_ADDR) {
-        *p->data_bus = *selected_data_register_A;
-        // Lower high bit, signaling that the character has been read and the register is available for kbd input
-        p->CRA &= 0x7F;
-      } else if(*p->addr_bus == p->PB_ADDR) {
-        *p->data_bus = *selected_data_register_B;
-      }
-    } else {
-      if(*p->addr_bus == p->CRA_ADDR) {
-        // Bits 6 and 7 are RO
-        p->CRA = *p->data_bus & 0x3F;
-      } else if(*p->addr_bus == p->CRB_ADDR) {
-        // Bits 6 and 7 are RO
-        p->CRB = *p->data_bus;
-      } else if(*p->addr_bus == p->PA_ADDR) {
-        *selected_data_register_A = *p->data_bus;
-      } else if(*p->addr_bus == p->PB_ADDR) {
-        // Not only set to value, but raise last bit
-        *selected_data_register_B = *p->data_bus | 0x80;
-      }
+    switch(*p->addr_bus & 0x03) {
+      case PIA_PA:
+        if(*p->RW) {
+          *p->data_bus = *selected_data_register_A;
+          // Lower high bit, signaling that the character has been read and the register is available for kbd input
+          p->CRA &= 0x7F;
+          if(!p->key_pending && key_waiting(&p->keyboard)) {
+            // Typed ahead
+            p->key_pending = schedule_event(p->scheduler, *p->scheduler->now + 1, &process_peripheral_A, p) == SUCCESS;
+          }
+        } else {
+          *selected_data_register_A = *p->data_bus;
+        }
+      break;
+      case PIA_CRA:
+        if(*p->RW) {
+          if(!(p->CRA & 0x80)) {
+            // The guest is waiting for a key, so it can take a pasted one
+            paste_key(p);
+          }
+          *p->data_bus = p->CRA;
+        } else {
+          // Bits 6 and 7 are RO
+          p->CRA = *p->data_bus & 0x3F;
+        }
+      break;
+      case PIA_PB:
+        if(*p->RW) {
+          *p->data_bus = *selected_data_register_B;
+        } else {
+          // Not only set to value, but raise last bit
+          *selected_data_register_B = *p->data_bus | 0x80;
+          if(selected_data_register_B == &p->PB && !p->display_pending) {
+            // Writing again before the display took the last one just
+            // replaces it, the event already queued will pick it up
+            p->display_pending = schedule_event(p->scheduler, *p->scheduler->now + p->display_cycles, &process_peripheral_B, p) == SUCCESS;
+          }
+        }
+      break;
+      case PIA_CRB:
+        if(*p->RW) {
+          *p->data_bus = p->CRB;
+        } else {
+          // Bits 6 and 7 are RO
+          p->CRB = *p->data_bus;
+        }
+      break;
     }
   }
 }
 
+void resume_pia(PIA6821* p) {
+  // Whatever was queued is gone, keys get picked up again by deliver_key
+  p->key_pending = false;
+  p->display_pending = false;
+  if(p->scheduler != NULL && (p->PB & 0x80)) {
+    p->display_pending = schedule_event(p->scheduler, *p->scheduler->now + p->display_cycles, &process_peripheral_B, p) == SUCCESS;
+  }
+}
+
 // return 0 if there are no more pending bytes - i.e: the user only pressed ESC
 char read_escape_sequence() {
   char sequence_buffer[16];
@@ -172,6 +283,18 @@ char read_escape_sequence() {
   if(*sequence_buffer == '\0') {
     return NO_SEQUENCE;
   }
+  // F2
+  if(!memcmp(sequence_buffer, "OQ", 3)) {
+    return EMULATOR_REWIND;
+  }
+  // F3
+  if(!memcmp(sequence_buffer, "OR", 3)) {
+    return EMULATOR_JIT;
+  }
+  // F4
+  if(!memcmp(sequence_buffer, "OS", 3)) {
+    return EMULATOR_INSTRUCTION_MODE;
+  }
   // F5
   if(!memcmp(sequence_buffer, "[15~", 5)) {
     return EMULATOR_CONTINUE;
@@ -219,37 +342,52 @@ void restore_term() {
 }
 
 void *input_run(void* ptr) {
-  volatile bool* stop = (bool*)ptr;
+  Apple1Machine* m = (Apple1Machine*)ptr;
+  PIA6821* p = &m->pia;
   char special_input;
-  while(!(*stop)) {
-    if(data_ready) {
-      // Don't read until the CPU has consumed the previous one
+  unsigned char key;
+  while(!m->poweroff) {
+    if(__atomic_load_n(&m->paste_fd, __ATOMIC_ACQUIRE) == STDIN_FILENO) {
+      // Being pasted in, the paste thread has it until it's done
+      pthread_mutex_lock(&m->paste_lock);
+      while(__atomic_load_n(&m->paste_fd, __ATOMIC_ACQUIRE) == STDIN_FILENO && !m->poweroff) {
+        pthread_cond_wait(&m->paste_done, &m->paste_lock);
+      }
+      pthread_mutex_unlock(&m->paste_lock);
       continue;
     }
-    ssize_t bytes_read = read(STDIN_FILENO, &pressed_key, 1);
+    // Blocks until there's something, the queue takes care of typing ahead
+    ssize_t bytes_read = read(STDIN_FILENO, &key, 1);
     if(bytes_read == -1) {
       if(errno == EINTR) {
         continue;
       }
       fprintf(stderr, "Error reading from stdin\n");
-    } else if(bytes_read == 1) {
-      switch(pressed_key) {
+    } else if(bytes_read == 0) {
+      // Nothing else is coming, just wait to be stopped
+      struct timespec wait = { .tv_sec = 0, .tv_nsec = KEYBOARD_FULL_TIMEOUT };
+      nanosleep(&wait, NULL);
+    } else {
+      switch(key) {
         case TILDE_KEY:
           clear_screen();
           continue;
         break;
         case TAB_KEY:
-          process_emulator_input(EMULATOR_TURBO);
+          process_emulator_input(m, EMULATOR_TURBO);
           continue;
         case ESC_KEY:
           special_input = read_escape_sequence();
           if(special_input) {
-            process_emulator_input(special_input);
+            process_emulator_input(m, special_input);
             continue;
           }
         break;
       }
-      data_ready = true;
+      if(push_key(&p->keyboard, key, &m->poweroff)) {
+        // The CPU might be parked waiting for it
+        wake_apple1(m);
+      }
     }
   }
   fprintf(stderr, "Stopping input thread...\n");
@@ -257,6 +395,64 @@ void *input_run(void* ptr) {
   pthread_exit(0);
 }
 
+void *paste_run(void* ptr) {
+  Apple1Machine* m = (Apple1Machine*)ptr;
+  PIA6821* p = &m->pia;
+  // Only ever changed here, once done with it
+  int fd = __atomic_load_n(&m->paste_fd, __ATOMIC_ACQUIRE);
+  while(!m->poweroff) {
+    if(m->paste_pos == m->paste_length) {
+      // Not blocking on it, a SIGINT would take the whole machine down rather
+      // than just stop us
+      struct pollfd ready = { .fd = fd, .events = POLLIN };
+      if(poll(&ready, 1, KEYBOARD_FULL_TIMEOUT / 1000000) == 0) {
+        continue;
+      }
+      ssize_t bytes_read = read(fd, m->paste_buffer, PASTE_CHUNK_SIZE);
+      if(bytes_read == -1) {
+        if(errno == EINTR) {
+          continue;
+        }
+        fprintf(stderr, "Error reading the keys to paste\n");
+        bytes_read = 0;
+      }
+      if(bytes_read == 0) {
+        // All pasted, the keyboard is all there is from now on
+        if(fd != STDIN_FILENO) {
+          close(fd);
+        }
+        // Handing stdin back to the input thread, if that's what it was
+        pthread_mutex_lock(&m->paste_lock);
+        __atomic_store_n(&m->paste_fd, -1, __ATOMIC_RELEASE);
+        pthread_cond_broadcast(&m->paste_done);
+        pthread_mutex_unlock(&m->paste_lock);
+        break;
+      }
+      m->paste_pos = 0;
+      m->paste_length = bytes_read;
+    }
+    unsigned char key = m->paste_buffer[m->paste_pos];
+    if(key == '\n' && m->paste_last == '\r') {
+      // CRLF is a single return
+      m->paste_last = key;
+      m->paste_pos++;
+      continue;
+    }
+    // The CPU might be parked, if it had nothing to read
+    bool wake = !key_waiting(&p->paste);
+    if(!push_key(&p->paste, key, &m->poweroff)) {
+      // Stopping, this one goes in when we're back
+      break;
+    }
+    m->paste_last = key;
+    m->paste_pos++;
+    if(wake) {
+      wake_apple1(m);
+    }
+  }
+  pthread_exit(0);
+}
+
 void init_pia() {
   // Set RAW mode
   tcgetattr(STDIN_FILENO, &orig_termios);
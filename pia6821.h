@@ -21,11 +21,36 @@
 #ifndef PIA6821_H
 #define PIA6821_H
 
+#include "scheduler.h"
+#include "display.h"
+
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
 
 #define DDR_FLAG 0x04
 #define MAX_COLUMNS 40
+// Cycles from the CPU writing DSP to the display taking the char, by default
+#define DISPLAY_LATENCY 1
+// Until trying again, when the display's buffer is full
+#define DISPLAY_BUSY_CYCLES 1000
+// Keys typed ahead of the guest reading them
+#define KEYBOARD_QUEUE_SIZE 256
+// Longest the input thread waits for room in the queue before checking if it
+// has to stop, in ns
+#define KEYBOARD_FULL_TIMEOUT 100000000
+// Bytes read at once from whatever is being pasted
+#define PASTE_CHUNK_SIZE 4096
+
+// Selected by RS0 and RS1, wired to A0 and A1. The bus only clocks the PIA for
+// its own 4 addresses
+enum pia_register {
+  PIA_PA = 0,
+  PIA_CRA = 1,
+  PIA_PB = 2,
+  PIA_CRB = 3
+};
 
 #define ESC_KEY 0x1B
 #define TILDE_KEY 0x60
@@ -42,10 +67,26 @@ enum emulator_input {
   EMULATOR_PRINT_CYCLES = 7,
   EMULATOR_SAVE_STATE = 8,
   EMULATOR_LOAD_STATE = 9,
-  EMULATOR_TURBO = 10
+  EMULATOR_TURBO = 10,
+  EMULATOR_INSTRUCTION_MODE = 11,
+  EMULATOR_JIT = 12,
+  EMULATOR_REWIND = 13
 };
 
 
+// From the input thread to the PIA, lock-free as long as there's room. Head
+// is only moved by the input thread, tail only by the CPU thread, both only
+// ever growing
+typedef struct {
+  unsigned char keys[KEYBOARD_QUEUE_SIZE];
+  size_t head;
+  size_t tail;
+  // The input thread waits here when it's full
+  bool waiting;
+  pthread_mutex_t lock;
+  pthread_cond_t room;
+} Keyboard_queue;
+
 // very limited implementation only for the Apple I, not cycle accurate and I don't care
 
 typedef struct {
@@ -53,21 +94,54 @@ typedef struct {
   uint8_t PB;  // high bit, yes, here, means DA is high, when printf finishes, drive it low. This is a char written by CPU
   uint8_t CRA; // high bit means char available
   uint8_t CRB; // just for show
-  uint16_t PA_ADDR;  // KBD char
-  uint16_t PB_ADDR;  // high bit, yes, here, means DA is high, when printf finishes, drive it low. This is a char written by CPU
-  uint16_t CRA_ADDR; // high bit means char available
-  uint16_t CRB_ADDR; // just for show
   uint8_t DDRA; // ignored
   uint8_t DDRB; // ignored as well
-  volatile bool* RES;
   volatile uint8_t* data_bus;
   volatile uint16_t* addr_bus;
   bool* RW;
+  // Takes the keyboard and display handshakes off the register accesses
+  Scheduler* scheduler;
+  // Set while there's an event queued for each side, so that the guest can't
+  // fill up the scheduler by hammering the registers
+  bool key_pending;
+  bool display_pending;
+  // Where the display goes, and how long it takes for every char
+  Display* display;
+  unsigned int display_cycles;
+  unsigned int current_col;
+  Keyboard_queue keyboard;
+  // From the paste thread. These only go in when the guest reads KBDCR and
+  // finds it empty, so they never get ahead of it
+  Keyboard_queue paste;
 } PIA6821;
 
+void init_keyboard(Keyboard_queue* q);
+void destroy_keyboard(Keyboard_queue* q);
+// On the input thread. Waits for room until it's there or stop is set, false
+// if it had to give up
+bool push_key(Keyboard_queue* q, unsigned char key, volatile bool* stop);
+// On the CPU thread, false if there's none
+bool pop_key(Keyboard_queue* q, unsigned char* key);
+
+static inline bool key_waiting(Keyboard_queue* q) {
+  return __atomic_load_n(&q->head, __ATOMIC_ACQUIRE) != q->tail;
+}
+
+static inline bool pia_key_waiting(PIA6821* p) {
+  return key_waiting(&p->keyboard) || key_waiting(&p->paste);
+}
+
 void clock_pia(void* ptr, bool status);
+// On the CPU thread, to pick up whatever key the input thread left
+void deliver_key(PIA6821* p);
+// Schedules again whatever the PIA had pending, after the scheduler has been
+// cleared
+void resume_pia(PIA6821* p);
 void init_pia();
+// Takes the Apple1Machine the keyboard goes to
 void *input_run(void* ptr);
+// Same, feeding it everything in its paste_fd
+void *paste_run(void* ptr);
 void clear_screen();
 
 #endif
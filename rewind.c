@@ -0,0 +1,219 @@
+/***************************************************************************
+ *   rewind.c  --  This file is part of apple1emu.                         *
+ *                                                                         *
+ *   Copyright (C) 2021 Imanol-Mikel Barba Sabariego                       *
+ *                                                                         *
+ *   apple1emu is free software: you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published     *
+ *   by the Free Software Foundation, either version 3 of the License,     *
+ *   or (at your option) any later version.                                *
+ *                                                                         *
+ *   apple1emu is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty           *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.               *
+ *   See the GNU General Public License for more details.                  *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "rewind.h"
+#include "apple1.h"
+#include "m6502_instr.h"
+
+#include <stdio.h>
+#include <string.h>
+
+void set_rewind(Apple1Machine* m, unsigned int interval_ms) {
+  destroy_rewind(m);
+  if(!interval_ms) {
+    return;
+  }
+  Rewind* r = calloc(1, sizeof(Rewind));
+  if(r != NULL) {
+    r->snapshots = calloc(REWIND_MAX_SNAPSHOTS, sizeof(Rewind_snapshot));
+  }
+  if(r == NULL || r->snapshots == NULL) {
+    fprintf(stderr, "Unable to alloc rewind buffer, running without it\n");
+    free(r);
+    return;
+  }
+  r->interval = (unsigned long long)interval_ms * CLOCK_SPEED / 1000;
+  r->next_capture = m->cpu.tick_count;
+
+  Mem_16* regions[MAX_STATE_REGIONS];
+  size_t num_regions = get_state_regions(m, regions);
+  for(size_t i = 0; i < num_regions; ++i) {
+    Mem_16* region = regions[i];
+    for(unsigned int page = region->start_addr / PAGE_SIZE; page <= region->end_addr / PAGE_SIZE; ++page) {
+      unsigned int start = page * PAGE_SIZE;
+      unsigned int end = start + PAGE_SIZE - 1;
+      if(start < region->start_addr) {
+        start = region->start_addr;
+      }
+      if(end > region->end_addr) {
+        end = region->end_addr;
+      }
+      r->pages[page].mem = region->mem + (start - region->start_addr);
+      r->pages[page].offset = start - page * PAGE_SIZE;
+      r->pages[page].length = end - start + 1;
+      memcpy(r->shadow + start, r->pages[page].mem, r->pages[page].length);
+    }
+    // The shadow is up to date now
+    uint64_t dirty[DIRTY_WORDS];
+    get_dirty_pages(region, dirty, true);
+  }
+  m->rewind = r;
+}
+
+// Pages written since the last time, across all the memory regions
+static void take_dirty_pages(Apple1Machine* m, uint64_t* dirty) {
+  Mem_16* regions[MAX_STATE_REGIONS];
+  size_t num_regions = get_state_regions(m, regions);
+  memset(dirty, 0x00, DIRTY_WORDS * sizeof(uint64_t));
+  for(size_t i = 0; i < num_regions; ++i) {
+    uint64_t region_dirty[DIRTY_WORDS];
+    get_dirty_pages(regions[i], region_dirty, true);
+    for(unsigned int word = 0; word < DIRTY_WORDS; ++word) {
+      dirty[word] |= region_dirty[word];
+    }
+  }
+}
+
+static bool is_dirty(const uint64_t* dirty, unsigned int page) {
+  return (dirty[page / 64] >> (page % 64)) & 1;
+}
+
+static void drop_pages(Rewind* r, Rewind_snapshot* s) {
+  r->bytes -= s->num_pages * sizeof(Rewind_page);
+  free(s->pages);
+  s->pages = NULL;
+  s->num_pages = 0;
+}
+
+static void drop_snapshots(Rewind* r) {
+  for(unsigned int i = 0; i < r->count; ++i) {
+    drop_pages(r, &r->snapshots[(r->first + i) % REWIND_MAX_SNAPSHOTS]);
+  }
+  r->count = 0;
+}
+
+void destroy_rewind(Apple1Machine* m) {
+  Rewind* r = m->rewind;
+  if(r == NULL) {
+    return;
+  }
+  drop_snapshots(r);
+  free(r->snapshots);
+  free(r);
+  m->rewind = NULL;
+}
+
+void reset_rewind_schedule(Apple1Machine* m) {
+  if(m->rewind != NULL) {
+    m->rewind->next_capture = m->cpu.tick_count;
+  }
+}
+
+static Rewind_snapshot* latest_snapshot(Rewind* r) {
+  return &r->snapshots[(r->first + r->count - 1) % REWIND_MAX_SNAPSHOTS];
+}
+
+void capture_rewind(Apple1Machine* m) {
+  Rewind* r = m->rewind;
+  if(r == NULL || m->cpu.tick_count < r->next_capture) {
+    return;
+  }
+  r->next_capture = m->cpu.tick_count + r->interval;
+
+  // The pages that changed since the latest snapshot go with it, as they were
+  // back then
+  if(r->count) {
+    Rewind_snapshot* latest = latest_snapshot(r);
+    uint64_t dirty[DIRTY_WORDS];
+    take_dirty_pages(m, dirty);
+    unsigned int changed[NUM_PAGES];
+    unsigned int num_changed = 0;
+    for(unsigned int page = 0; page < NUM_PAGES; ++page) {
+      Rewind_page_map* p = &r->pages[page];
+      // Written to doesn't mean changed
+      if(p->mem != NULL && is_dirty(dirty, page) && memcmp(r->shadow + page * PAGE_SIZE + p->offset, p->mem, p->length)) {
+        changed[num_changed++] = page;
+      }
+    }
+    if(num_changed) {
+      latest->pages = malloc(num_changed * sizeof(Rewind_page));
+      if(latest->pages != NULL) {
+        latest->num_pages = num_changed;
+        r->bytes += num_changed * sizeof(Rewind_page);
+      } else {
+        // Can't go back past this point anymore
+        drop_snapshots(r);
+      }
+    }
+    for(unsigned int i = 0; i < num_changed; ++i) {
+      Rewind_page_map* p = &r->pages[changed[i]];
+      uint8_t* shadow = r->shadow + changed[i] * PAGE_SIZE + p->offset;
+      if(latest->pages != NULL) {
+        latest->pages[i].page = changed[i];
+        memcpy(latest->pages[i].data + p->offset, shadow, p->length);
+      }
+      memcpy(shadow, p->mem, p->length);
+    }
+  }
+
+  while(r->count && (r->count == REWIND_MAX_SNAPSHOTS || r->bytes > REWIND_MAX_BYTES)) {
+    drop_pages(r, &r->snapshots[r->first]);
+    r->first = (r->first + 1) % REWIND_MAX_SNAPSHOTS;
+    r->count--;
+  }
+  r->count++;
+  Rewind_snapshot* s = latest_snapshot(r);
+  get_cpu_state(&m->cpu, &s->cpu);
+  get_pia_state(&m->pia, &s->pia);
+}
+
+unsigned int rewind_apple1(Apple1Machine* m, unsigned int steps) {
+  Rewind* r = m->rewind;
+  if(r == NULL || !r->count || !steps) {
+    return 0;
+  }
+  // Back to the latest snapshot first, whatever changed since is only in
+  // memory
+  uint64_t dirty[DIRTY_WORDS];
+  take_dirty_pages(m, dirty);
+  for(unsigned int page = 0; page < NUM_PAGES; ++page) {
+    Rewind_page_map* p = &r->pages[page];
+    if(p->mem != NULL && is_dirty(dirty, page)) {
+      memcpy(p->mem, r->shadow + page * PAGE_SIZE + p->offset, p->length);
+    }
+  }
+  unsigned int rewound = 0;
+  if(latest_snapshot(r)->cpu.tick_count != m->cpu.tick_count) {
+    // That one was already a step back
+    steps--;
+    rewound++;
+  }
+  for(; steps && r->count > 1; --steps, ++rewound) {
+    r->count--;
+    Rewind_snapshot* s = latest_snapshot(r);
+    for(unsigned int i = 0; i < s->num_pages; ++i) {
+      Rewind_page_map* p = &r->pages[s->pages[i].page];
+      memcpy(p->mem, s->pages[i].data + p->offset, p->length);
+      memcpy(r->shadow + s->pages[i].page * PAGE_SIZE + p->offset, p->mem, p->length);
+    }
+    drop_pages(r, s);
+  }
+
+  Rewind_snapshot* s = latest_snapshot(r);
+  set_cpu_state(&m->cpu, &s->cpu);
+  set_pia_state(&m->pia, &s->pia);
+  r->next_capture = m->cpu.tick_count + r->interval;
+  // The memory changed without any writes going through the bus
+  flush_decoded(&m->cpu);
+  // Pending events were for the cycle count we just left
+  clear_events(&m->scheduler);
+  resume_pia(&m->pia);
+  return rewound;
+}
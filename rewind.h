@@ -0,0 +1,83 @@
+/***************************************************************************
+ *   rewind.h  --  This file is part of apple1emu.                         *
+ *                                                                         *
+ *   Copyright (C) 2021 Imanol-Mikel Barba Sabariego                       *
+ *                                                                         *
+ *   apple1emu is free software: you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published     *
+ *   by the Free Software Foundation, either version 3 of the License,     *
+ *   or (at your option) any later version.                                *
+ *                                                                         *
+ *   apple1emu is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty           *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.               *
+ *   See the GNU General Public License for more details.                  *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef REWIND_H
+#define REWIND_H
+
+#include "m6502.h"
+#include "savestate.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Emulated milliseconds between snapshots
+#define DEFAULT_REWIND_INTERVAL 100
+// History kept, whichever runs out first drops the oldest snapshots
+#define REWIND_MAX_SNAPSHOTS 4096
+#define REWIND_MAX_BYTES (4 * 1024 * 1024)
+
+// What was on a page of memory when the snapshot was taken
+typedef struct {
+  uint8_t page;
+  uint8_t data[PAGE_SIZE];
+} Rewind_page;
+
+typedef struct {
+  M6502_State cpu;
+  PIA6821_State pia;
+  // Pages that changed between this snapshot and the next one, as they were
+  // at this one. Empty for the latest
+  Rewind_page* pages;
+  unsigned int num_pages;
+} Rewind_snapshot;
+
+// Where every page of the address space is in the memory regions, if it is
+typedef struct {
+  uint8_t* mem;
+  uint16_t offset;
+  uint16_t length;
+} Rewind_page_map;
+
+typedef struct Rewind {
+  unsigned long long interval;
+  unsigned long long next_capture;
+  // Ring of snapshots, oldest first
+  Rewind_snapshot* snapshots;
+  unsigned int first;
+  unsigned int count;
+  size_t bytes;
+  Rewind_page_map pages[NUM_PAGES];
+  // Memory as it was at the latest snapshot, by address
+  uint8_t shadow[MEMSIZE];
+} Rewind;
+
+// Takes a snapshot every interval_ms emulated milliseconds, 0 turns it off
+void set_rewind(Apple1Machine* m, unsigned int interval_ms);
+void destroy_rewind(Apple1Machine* m);
+// Called by the CPU thread between batches of cycles
+void capture_rewind(Apple1Machine* m);
+// Takes the next snapshot as soon as possible, for when the cycle count jumped
+// back, like when loading a state
+void reset_rewind_schedule(Apple1Machine* m);
+// Goes back steps snapshots, counting the one we're at if nothing ran since.
+// Only while the machine isn't running. Returns how many it went back
+unsigned int rewind_apple1(Apple1Machine* m, unsigned int steps);
+
+#endif
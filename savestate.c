@@ -0,0 +1,251 @@
+/***************************************************************************
+ *   savestate.c  --  This file is part of apple1emu.                      *
+ *                                                                         *
+ *   Copyright (C) 2021 Imanol-Mikel Barba Sabariego                       *
+ *                                                                         *
+ *   apple1emu is free software: you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published     *
+ *   by the Free Software Foundation, either version 3 of the License,     *
+ *   or (at your option) any later version.                                *
+ *                                                                         *
+ *   apple1emu is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty           *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.               *
+ *   See the GNU General Public License for more details.                  *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "savestate.h"
+#include "rewind.h"
+#include "m6502_instr.h"
+#include "errors.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+size_t get_state_regions(Apple1Machine* m, Mem_16** regions) {
+  size_t num_regions = 0;
+  Mem_16* all[] = { &m->user_ram, &m->extra_ram, &m->rom };
+  for(size_t i = 0; i < sizeof(all) / sizeof(all[0]); ++i) {
+    if(all[i]->mem != NULL) {
+      regions[num_regions++] = all[i];
+    }
+  }
+  return num_regions;
+}
+
+static size_t region_size(Mem_16* region) {
+  return (size_t)(region->end_addr - region->start_addr) + 1;
+}
+
+void get_pia_state(PIA6821* p, PIA6821_State* state) {
+  state->PA = p->PA;
+  state->PB = p->PB;
+  state->CRA = p->CRA;
+  state->CRB = p->CRB;
+  state->DDRA = p->DDRA;
+  state->DDRB = p->DDRB;
+  state->current_col = p->current_col;
+}
+
+void set_pia_state(PIA6821* p, const PIA6821_State* state) {
+  p->PA = state->PA;
+  p->PB = state->PB;
+  p->CRA = state->CRA;
+  p->CRB = state->CRB;
+  p->DDRA = state->DDRA;
+  p->DDRB = state->DDRB;
+  p->current_col = state->current_col;
+}
+
+void get_savestate_path(Apple1Machine* m, unsigned int slot, char* path, size_t path_size) {
+  if(slot) {
+    snprintf(path, path_size, "%s.%u", m->savestate_path, slot);
+  } else {
+    snprintf(path, path_size, "%s", m->savestate_path);
+  }
+}
+
+int save_apple1_state(Apple1Machine* m, unsigned int slot) {
+  Mem_16* regions[MAX_STATE_REGIONS];
+  size_t num_regions = get_state_regions(m, regions);
+  size_t size = sizeof(Savestate_header) + sizeof(M6502_State) + sizeof(PIA6821_State) + sizeof(Clock_State);
+  for(size_t i = 0; i < num_regions; ++i) {
+    size += sizeof(Region_header) + region_size(regions[i]);
+  }
+  uint8_t* data = malloc(size);
+  if(data == NULL) {
+    fprintf(stderr, "Unable to alloc savestate\n");
+    return ERROR_MEMORY_ALLOC;
+  }
+
+  // Everything is copied as is, no bus involved
+  uint8_t* pos = data;
+  Savestate_header* header = (Savestate_header*)pos;
+  memcpy(header->magic, SAVESTATE_MAGIC, SAVESTATE_MAGIC_SIZE);
+  header->version = SAVESTATE_VERSION;
+  header->num_regions = num_regions;
+  pos += sizeof(Savestate_header);
+
+  get_cpu_state(&m->cpu, (M6502_State*)pos);
+  pos += sizeof(M6502_State);
+
+  get_pia_state(&m->pia, (PIA6821_State*)pos);
+  pos += sizeof(PIA6821_State);
+
+  Clock_State* clock = (Clock_State*)pos;
+  clock->freq = m->main_clock.freq;
+  clock->turbo = m->main_clock.turbo ? 1 : 0;
+  pos += sizeof(Clock_State);
+
+  for(size_t i = 0; i < num_regions; ++i) {
+    Region_header* region = (Region_header*)pos;
+    region->start_addr = regions[i]->start_addr;
+    region->end_addr = regions[i]->end_addr;
+    pos += sizeof(Region_header);
+    memcpy(pos, regions[i]->mem, region_size(regions[i]));
+    pos += region_size(regions[i]);
+  }
+
+  char path[MAX_SAVESTATE_PATH];
+  get_savestate_path(m, slot, path, sizeof(path));
+  int fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+  if(fd == -1) {
+    fprintf(stderr, "Error opening savestate: %s\n", path);
+    free(data);
+    return ERROR_OPEN_FILE;
+  }
+  size_t total = 0;
+  while(total != size) {
+    ssize_t written = write(fd, data + total, size - total);
+    if(written < 0) {
+      if(errno == EINTR) {
+        continue;
+      }
+      fprintf(stderr, "Error writing savestate: %s\n", path);
+      close(fd);
+      free(data);
+      return ERROR_WRITE_FILE;
+    }
+    total += written;
+  }
+  close(fd);
+  free(data);
+  fprintf(stderr, "State saved to \"%s\"\n", path);
+  return SUCCESS;
+}
+
+// Reads the whole file, so that it can be checked before touching anything
+static int read_savestate(const char* path, uint8_t** data, size_t* size) {
+  int fd = open(path, O_RDONLY);
+  if(fd == -1) {
+    fprintf(stderr, "Error opening savestate: %s\n", path);
+    return ERROR_OPEN_FILE;
+  }
+  struct stat st;
+  if(fstat(fd, &st) == -1) {
+    fprintf(stderr, "Error reading savestate: %s\n", path);
+    close(fd);
+    return ERROR_READ_FILE;
+  }
+  *size = st.st_size;
+  *data = malloc(*size ? *size : 1);
+  if(*data == NULL) {
+    fprintf(stderr, "Unable to alloc savestate\n");
+    close(fd);
+    return ERROR_MEMORY_ALLOC;
+  }
+  size_t total = 0;
+  while(total != *size) {
+    ssize_t bytes_read = read(fd, *data + total, *size - total);
+    if(bytes_read <= 0) {
+      if(bytes_read < 0 && errno == EINTR) {
+        continue;
+      }
+      fprintf(stderr, "Error reading savestate: %s\n", path);
+      free(*data);
+      close(fd);
+      return ERROR_READ_FILE;
+    }
+    total += bytes_read;
+  }
+  close(fd);
+  return SUCCESS;
+}
+
+int load_apple1_state(Apple1Machine* m, unsigned int slot) {
+  char path[MAX_SAVESTATE_PATH];
+  get_savestate_path(m, slot, path, sizeof(path));
+  uint8_t* data;
+  size_t size;
+  int ret = read_savestate(path, &data, &size);
+  if(ret != SUCCESS) {
+    return ret;
+  }
+
+  // Has to be for this very same memory layout
+  Mem_16* regions[MAX_STATE_REGIONS];
+  size_t num_regions = get_state_regions(m, regions);
+  size_t expected = sizeof(Savestate_header) + sizeof(M6502_State) + sizeof(PIA6821_State) + sizeof(Clock_State);
+  Savestate_header* header = (Savestate_header*)data;
+  if(size < sizeof(Savestate_header) || memcmp(header->magic, SAVESTATE_MAGIC, SAVESTATE_MAGIC_SIZE)) {
+    fprintf(stderr, "Not a savestate: %s\n", path);
+    free(data);
+    return FAILURE;
+  }
+  if(header->version != SAVESTATE_VERSION) {
+    fprintf(stderr, "Unsupported savestate version %u (expected %u): %s\n", header->version, SAVESTATE_VERSION, path);
+    free(data);
+    return FAILURE;
+  }
+  bool matching = header->num_regions == num_regions;
+  for(size_t i = 0; matching && i < num_regions; ++i) {
+    Region_header* region = (Region_header*)(data + expected);
+    matching = expected + sizeof(Region_header) <= size
+      && region->start_addr == regions[i]->start_addr
+      && region->end_addr == regions[i]->end_addr;
+    expected += sizeof(Region_header) + region_size(regions[i]);
+  }
+  if(!matching || expected != size) {
+    fprintf(stderr, "Savestate doesn't match the memory of this machine: %s\n", path);
+    free(data);
+    return FAILURE;
+  }
+
+  uint8_t* pos = data + sizeof(Savestate_header);
+  set_cpu_state(&m->cpu, (M6502_State*)pos);
+  pos += sizeof(M6502_State);
+
+  set_pia_state(&m->pia, (PIA6821_State*)pos);
+  pos += sizeof(PIA6821_State);
+
+  Clock_State* clock = (Clock_State*)pos;
+  m->main_clock.freq = clock->freq;
+  m->main_clock.turbo = clock->turbo ? true : false;
+  pos += sizeof(Clock_State);
+
+  for(size_t i = 0; i < num_regions; ++i) {
+    pos += sizeof(Region_header);
+    memcpy(regions[i]->mem, pos, region_size(regions[i]));
+    mark_range_dirty(regions[i], regions[i]->start_addr, regions[i]->end_addr);
+    pos += region_size(regions[i]);
+  }
+  free(data);
+
+  // The memory changed without any writes going through the bus
+  flush_decoded(&m->cpu);
+  // Pending events were for the cycle count we just left
+  clear_events(&m->scheduler);
+  resume_pia(&m->pia);
+  // The next snapshot was due at a cycle count that could be way ahead now
+  reset_rewind_schedule(m);
+  fprintf(stderr, "State loaded from \"%s\"\n", path);
+  return SUCCESS;
+}
@@ -0,0 +1,76 @@
+/***************************************************************************
+ *   savestate.h  --  This file is part of apple1emu.                      *
+ *                                                                         *
+ *   Copyright (C) 2021 Imanol-Mikel Barba Sabariego                       *
+ *                                                                         *
+ *   apple1emu is free software: you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published     *
+ *   by the Free Software Foundation, either version 3 of the License,     *
+ *   or (at your option) any later version.                                *
+ *                                                                         *
+ *   apple1emu is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty           *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.               *
+ *   See the GNU General Public License for more details.                  *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef SAVESTATE_H
+#define SAVESTATE_H
+
+#include "apple1.h"
+
+#include <stdint.h>
+
+#define SAVESTATE_MAGIC "A1EMUSAV"
+#define SAVESTATE_MAGIC_SIZE 8
+// Bump whenever any of the sections below changes
+#define SAVESTATE_VERSION 3
+#define DEFAULT_SAVESTATE_PATH "savestate"
+#define MAX_SAVESTATE_PATH 4096
+#define MAX_STATE_REGIONS 3
+
+// A savestate is this header, the CPU (M6502_State), the PIA, the clock and
+// then every memory region: its range followed by its contents
+typedef struct {
+  char magic[SAVESTATE_MAGIC_SIZE];
+  uint32_t version;
+  uint32_t num_regions;
+} __attribute__((packed)) Savestate_header;
+
+typedef struct {
+  uint8_t PA;
+  uint8_t PB;
+  uint8_t CRA;
+  uint8_t CRB;
+  uint8_t DDRA;
+  uint8_t DDRB;
+  uint8_t current_col;
+} __attribute__((packed)) PIA6821_State;
+
+typedef struct {
+  uint32_t freq;
+  uint8_t turbo;
+} __attribute__((packed)) Clock_State;
+
+typedef struct {
+  uint16_t start_addr;
+  uint16_t end_addr;
+} __attribute__((packed)) Region_header;
+
+// Every memory the machine has (up to MAX_STATE_REGIONS), in the order they're
+// saved
+size_t get_state_regions(Apple1Machine* m, Mem_16** regions);
+void get_pia_state(PIA6821* p, PIA6821_State* state);
+void set_pia_state(PIA6821* p, const PIA6821_State* state);
+
+// Slot 0 goes to the savestate path as is, any other to PATH.SLOT
+void get_savestate_path(Apple1Machine* m, unsigned int slot, char* path, size_t path_size);
+// Both only while the machine isn't running. Nothing changes if loading fails
+int save_apple1_state(Apple1Machine* m, unsigned int slot);
+int load_apple1_state(Apple1Machine* m, unsigned int slot);
+
+#endif
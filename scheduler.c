@@ -0,0 +1,85 @@
+/***************************************************************************
+ *   scheduler.c  --  This file is part of apple1emu.                      *
+ *                                                                         *
+ *   Copyright (C) 2021 Imanol-Mikel Barba Sabariego                       *
+ *                                                                         *
+ *   apple1emu is free software: you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published     *
+ *   by the Free Software Foundation, either version 3 of the License,     *
+ *   or (at your option) any later version.                                *
+ *                                                                         *
+ *   apple1emu is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty           *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.               *
+ *   See the GNU General Public License for more details.                  *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "scheduler.h"
+#include "errors.h"
+
+#include <stdio.h>
+
+void init_scheduler(Scheduler* s, unsigned long long* now, bool* preempt) {
+  s->num_events = 0;
+  s->now = now;
+  s->preempt = preempt;
+  s->horizon = 0;
+}
+
+int schedule_event(Scheduler* s, unsigned long long cycle, event_callback callback, void* data) {
+  if(s->num_events == MAX_EVENTS) {
+    fprintf(stderr, "Too many events scheduled\n");
+    return FAILURE;
+  }
+  // Sift up from the bottom of the heap
+  unsigned int i = s->num_events++;
+  while(i && s->events[(i - 1) / 2].cycle > cycle) {
+    s->events[i] = s->events[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  s->events[i].cycle = cycle;
+  s->events[i].callback = callback;
+  s->events[i].data = data;
+  if(cycle < s->horizon && s->preempt != NULL) {
+    *s->preempt = true;
+  }
+  return SUCCESS;
+}
+
+void clear_events(Scheduler* s) {
+  s->num_events = 0;
+}
+
+static void pop_event(Scheduler* s) {
+  // Sift the last one down from the top
+  Event last = s->events[--s->num_events];
+  unsigned int i = 0;
+  while(true) {
+    unsigned int child = 2 * i + 1;
+    if(child >= s->num_events) {
+      break;
+    }
+    if(child + 1 < s->num_events && s->events[child + 1].cycle < s->events[child].cycle) {
+      child++;
+    }
+    if(s->events[child].cycle >= last.cycle) {
+      break;
+    }
+    s->events[i] = s->events[child];
+    i = child;
+  }
+  s->events[i] = last;
+}
+
+void run_events(Scheduler* s) {
+  while(s->num_events && s->events[0].cycle <= *s->now) {
+    // Popped before running, the callback might schedule the next one
+    Event e = s->events[0];
+    pop_event(s);
+    (*e.callback)(e.data);
+  }
+}
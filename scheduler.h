@@ -0,0 +1,63 @@
+/***************************************************************************
+ *   scheduler.h  --  This file is part of apple1emu.                      *
+ *                                                                         *
+ *   Copyright (C) 2021 Imanol-Mikel Barba Sabariego                       *
+ *                                                                         *
+ *   apple1emu is free software: you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published     *
+ *   by the Free Software Foundation, either version 3 of the License,     *
+ *   or (at your option) any later version.                                *
+ *                                                                         *
+ *   apple1emu is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty           *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.               *
+ *   See the GNU General Public License for more details.                  *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MAX_EVENTS 64
+#define NO_EVENT (~0ULL)
+
+typedef void (*event_callback)(void*);
+typedef struct {
+  unsigned long long cycle;
+  event_callback callback;
+  void* data;
+} Event;
+
+// Events by the emulated cycle they're due at, so that devices only get to
+// run when they have something to do. Everything here happens on the CPU
+// thread
+typedef struct Scheduler {
+  // Min-heap on cycle
+  Event events[MAX_EVENTS];
+  unsigned int num_events;
+  // Current cycle
+  unsigned long long* now;
+  // Set when an event is scheduled before the end of the current run, so
+  // that it stops in time for it
+  bool* preempt;
+  unsigned long long horizon;
+} Scheduler;
+
+void init_scheduler(Scheduler* s, unsigned long long* now, bool* preempt);
+int schedule_event(Scheduler* s, unsigned long long cycle, event_callback callback, void* data);
+// Drops every pending event, i.e. when the cycle count jumps
+void clear_events(Scheduler* s);
+// Runs every event that is due by now, earliest first
+void run_events(Scheduler* s);
+
+static inline unsigned long long next_event(Scheduler* s) {
+  return s->num_events ? s->events[0].cycle : NO_EVENT;
+}
+
+#endif
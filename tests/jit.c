@@ -0,0 +1,132 @@
+/***************************************************************************
+ *   jit.c  --  This file is part of apple1emu.                            *
+ *                                                                         *
+ *   Copyright (C) 2021 Imanol-Mikel Barba Sabariego                       *
+ *                                                                         *
+ *   apple1emu is free software: you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published     *
+ *   by the Free Software Foundation, either version 3 of the License,     *
+ *   or (at your option) any later version.                                *
+ *                                                                         *
+ *   apple1emu is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty           *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.               *
+ *   See the GNU General Public License for more details.                  *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.   *
+ *                                                                         *
+ ***************************************************************************/
+
+// Runs the same programs interpreted and translated, in slices of a few
+// cycles with an NMI halfway through, and checks that both CPUs end up in the
+// exact same state after every slice. Covers code modifying itself, blocks
+// stopping at the end of the slice, and interrupts being taken at the same
+// instruction boundary.
+
+#include "../apple1.h"
+#include "../m6502.h"
+#include "../m6502_jit.h"
+#include "../errors.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define PROGRAM_ADDR 0x0400
+#define NMI_HANDLER_ADDR 0x0500
+#define TABLE_ADDR 0x0600
+#define NMI_COUNT_ADDR 0x0700
+#define SLICES 20000
+#define NMI_SLICE 15000
+
+static uint8_t program[] = {
+  // Fills the table with 0..255, bumping the LDA operand on every iteration
+  0xA2, 0x00,             // 0400 LDX #$00
+  0xA9, 0x00,             // 0402 LDA #$00
+  0x9D, 0x00, 0x06,       // 0404 STA $0600,X
+  0xEE, 0x03, 0x04,       // 0407 INC $0403
+  0xE8,                   // 040A INX
+  0xD0, 0xF5,             // 040B BNE $0402
+  // Then spins on a block longer than most slices
+  0xC8, 0xC8, 0xC8, 0xC8, 0xC8, 0xC8, 0xC8, 0xC8, // 040D INY...
+  0xC8, 0xC8, 0xC8, 0xC8, 0xC8, 0xC8, 0xC8, 0xC8,
+  0xC8, 0xC8, 0xC8, 0xC8, 0xC8, 0xC8, 0xC8, 0xC8,
+  0x18,                   // 0425 CLC
+  0x69, 0x01,             // 0426 ADC #$01
+  0xD0, 0xE3,             // 0428 BNE $040D
+  0x4C, 0x0D, 0x04,       // 042A JMP $040D
+};
+
+static uint8_t nmi_handler[] = {
+  0xEE, 0x00, 0x07,       // 0500 INC $0700
+  0x40,                   // 0503 RTI
+};
+
+static Apple1Machine* create_machine(bool jit) {
+  Apple1Machine* m = create_apple1();
+  if(m == NULL || init_apple1_binary(m, program, sizeof(program), PROGRAM_ADDR, PROGRAM_ADDR) != SUCCESS) {
+    return NULL;
+  }
+  memcpy(m->user_ram.mem + NMI_HANDLER_ADDR, nmi_handler, sizeof(nmi_handler));
+  m->user_ram.mem[NMI_VECTOR_ADDR] = NMI_HANDLER_ADDR & 0x00FF;
+  m->user_ram.mem[NMI_VECTOR_ADDR + 1] = NMI_HANDLER_ADDR >> 8;
+  init_cpu(&m->cpu);
+  set_instruction_mode(m, true);
+  if(jit) {
+    set_jit(m, true);
+  }
+  return m;
+}
+
+static bool same_state(M6502* a, M6502* b) {
+  return a->tick_count == b->tick_count && a->instructions == b->instructions &&
+         a->PC == b->PC && a->A == b->A && a->X == b->X && a->Y == b->Y &&
+         a->S == b->S && a->status == b->status;
+}
+
+int main() {
+  Apple1Machine* interpreted = create_machine(false);
+  Apple1Machine* translated = create_machine(true);
+  if(interpreted == NULL || translated == NULL || translated->cpu.jit == NULL) {
+    fprintf(stderr, "Unable to set up the machines\n");
+    return FAILURE;
+  }
+  M6502* a = &interpreted->cpu;
+  M6502* b = &translated->cpu;
+  for(unsigned int i = 0; i < SLICES; ++i) {
+    if(i == NMI_SLICE || i == NMI_SLICE + 1) {
+      cpu_set_line(a, LINE_NMI, i == NMI_SLICE);
+      cpu_set_line(b, LINE_NMI, i == NMI_SLICE);
+    }
+    unsigned int slice = 1 + (i * 7) % 23;
+    cpu_run_cycles(a, slice);
+    cpu_run_cycles(b, slice);
+    if(!same_state(a, b)) {
+      fprintf(stderr, "Slice %u: interpreted PC=%04X cycles=%llu, translated PC=%04X cycles=%llu\n",
+        i, a->PC, a->tick_count, b->PC, b->tick_count);
+      return FAILURE;
+    }
+  }
+  if(memcmp(interpreted->user_ram.mem, translated->user_ram.mem, MEMSIZE)) {
+    fprintf(stderr, "Memory differs\n");
+    return FAILURE;
+  }
+  for(unsigned int i = 0; i < 0x100; ++i) {
+    if(translated->user_ram.mem[TABLE_ADDR + i] != i) {
+      fprintf(stderr, "Wrong value at %04X\n", TABLE_ADDR + i);
+      return FAILURE;
+    }
+  }
+  if(translated->user_ram.mem[NMI_COUNT_ADDR] != 1) {
+    fprintf(stderr, "NMI not taken\n");
+    return FAILURE;
+  }
+  if(!translated->cpu.jit->code_used) {
+    fprintf(stderr, "Nothing got translated\n");
+    return FAILURE;
+  }
+  printf("PASS: %llu cycles\n", b->tick_count);
+  destroy_apple1(interpreted);
+  destroy_apple1(translated);
+  return SUCCESS;
+}
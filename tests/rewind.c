@@ -0,0 +1,89 @@
+/***************************************************************************
+ *   rewind.c  --  This file is part of apple1emu.                         *
+ *                                                                         *
+ *   Copyright (C) 2021 Imanol-Mikel Barba Sabariego                       *
+ *                                                                         *
+ *   apple1emu is free software: you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published     *
+ *   by the Free Software Foundation, either version 3 of the License,     *
+ *   or (at your option) any later version.                                *
+ *                                                                         *
+ *   apple1emu is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty           *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.               *
+ *   See the GNU General Public License for more details.                  *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.   *
+ *                                                                         *
+ ***************************************************************************/
+
+// Loads a state saved further back than the latest rewind snapshot, and checks
+// that snapshots keep being taken right away instead of once the cycle count
+// catches up with where it was before loading.
+
+#include "../apple1.h"
+#include "../savestate.h"
+#include "../rewind.h"
+#include "../errors.h"
+
+#include <stdio.h>
+
+#define PROGRAM_ADDR 0x0400
+// Milliseconds, so 1000 cycles
+#define REWIND_INTERVAL 1
+#define SLICE_CYCLES 500
+#define SAVE_CYCLES 20000
+#define LOAD_CYCLES 200000
+#define AFTER_LOAD_CYCLES 5000
+
+static uint8_t program[] = {
+  0xEE, 0x00, 0x06,       // 0400 INC $0600
+  0xEE, 0x01, 0x06,       // 0403 INC $0601
+  0x4C, 0x00, 0x04,       // 0406 JMP $0400
+};
+
+static void run(Apple1Machine* m, unsigned long long until) {
+  while(m->cpu.tick_count < until) {
+    run_apple1_cycles(m, SLICE_CYCLES);
+    capture_rewind(m);
+  }
+}
+
+int main(int argc, char** argv) {
+  if(argc < 2) {
+    fprintf(stderr, "%s SAVESTATE_PATH\n", argv[0]);
+    return FAILURE;
+  }
+  Apple1Machine* m = create_apple1();
+  if(m == NULL || init_apple1_binary(m, program, sizeof(program), PROGRAM_ADDR, PROGRAM_ADDR) != SUCCESS) {
+    fprintf(stderr, "Unable to set up the machine\n");
+    return FAILURE;
+  }
+  init_cpu(&m->cpu);
+  m->savestate_path = argv[1];
+  set_rewind(m, REWIND_INTERVAL);
+  if(m->rewind == NULL) {
+    return FAILURE;
+  }
+
+  run(m, SAVE_CYCLES);
+  if(save_apple1_state(m, 0) != SUCCESS) {
+    return FAILURE;
+  }
+  run(m, LOAD_CYCLES);
+  if(load_apple1_state(m, 0) != SUCCESS) {
+    return FAILURE;
+  }
+  unsigned int before = m->rewind->count;
+  run(m, m->cpu.tick_count + AFTER_LOAD_CYCLES);
+  unsigned int taken = m->rewind->count - before;
+  // One per interval, give or take the slices
+  if(taken < AFTER_LOAD_CYCLES / (REWIND_INTERVAL * 1000) - 1) {
+    fprintf(stderr, "Only %u snapshots taken in %u cycles after loading\n", taken, AFTER_LOAD_CYCLES);
+    return FAILURE;
+  }
+  printf("PASS: %u snapshots after loading\n", taken);
+  destroy_apple1(m);
+  return SUCCESS;
+}